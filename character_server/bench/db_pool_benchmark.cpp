@@ -0,0 +1,99 @@
+/**
+ * \file db_pool_benchmark.cpp
+ * \brief Measures DatabaseManager throughput for growing connection pool sizes
+ *
+ * Runs a fixed number of worker threads issuing getCharacter() calls against a
+ * live MySQL server, once per pool size (1, 2, 4, ... up to the worker count),
+ * and prints the achieved operations per second for each size. The character
+ * cache entry is dropped before every read, so each call is a pooled query.
+ * An existing row is read; on an empty table one row is added and removed again.
+ *
+ * Usage: db_pool_benchmark [threads] [seconds] [host] [user] [password] [database]
+ */
+
+#include "database_manager.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    size_t threadCount = argc > 1 ? std::stoul(argv[1]) : Protocol::THREAD_POOL_SIZE;
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+    std::string host = argc > 3 ? argv[3] : "localhost";
+    std::string user = argc > 4 ? argv[4] : "character_user";
+    std::string pass = argc > 5 ? argv[5] : "secure_password_123";
+    std::string db = argc > 6 ? argv[6] : "character_db";
+
+    auto& database = DatabaseManager::getInstance();
+    if (!database.initialize(host, user, pass, db, 1)) {
+        std::cerr << "Failed to connect to MySQL" << std::endl;
+        return 1;
+    }
+
+    // Read an existing row, only an empty table gets a row of our own
+    bool seeded = false;
+    auto characters = database.getCharacterRange(std::nullopt, 1, false);
+    if (characters.empty()) {
+        CharacterData seed;
+        seed.name = "Bench";
+        seed.surname = "Mark";
+        seed.age = 42;
+        seed.bio = "Row used by db_pool_benchmark";
+        seeded = database.addCharacter(seed);
+        characters = database.getCharacterRange(std::nullopt, 1, false);
+    }
+    if (characters.empty()) {
+        std::cerr << "No characters to read" << std::endl;
+        return 1;
+    }
+    const int id = characters.front().id;
+
+    std::cout << "threads=" << threadCount << " duration=" << seconds << "s" << std::endl;
+    std::cout << std::setw(10) << "pool" << std::setw(16) << "ops/s" << std::endl;
+
+    for (size_t poolSize = 1; poolSize <= threadCount; poolSize *= 2) {
+        if (!database.initialize(host, user, pass, db, poolSize)) {
+            std::cerr << "Failed to open pool of " << poolSize << std::endl;
+            return 1;
+        }
+
+        std::atomic<bool> running{true};
+        std::atomic<uint64_t> operations{0};
+        std::vector<std::thread> workers;
+        workers.reserve(threadCount);
+
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([&] {
+                uint64_t local = 0;
+                while (running.load(std::memory_order_relaxed)) {
+                    // Measure the pool, not the cache
+                    database.cache().invalidate(id);
+                    if (database.getCharacter(id)) {
+                        ++local;
+                    }
+                }
+                operations += local;
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        running = false;
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        std::cout << std::setw(10) << poolSize
+                  << std::setw(16) << operations.load() / seconds << std::endl;
+    }
+
+    if (seeded) {
+        database.deleteCharacter(id);
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * \file serialization_benchmark.cpp
+ * \brief Compares the generated character serializer with a hand-written one
+ *
+ * Encodes, sizes and decodes a fixed set of characters many times, once with
+ * CharacterLayout / CharacterViewLayout and once with field-by-field code as
+ * protocol.cpp had it before the layouts, and prints nanoseconds per
+ * character for each. Both sides are called inline, so the numbers compare
+ * the generated code itself. Needs no server, build with optimizations.
+ *
+ * Usage: serialization_benchmark [iterations] [characters]
+ */
+
+#include "protocol.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Reference implementation, written out per field
+
+size_t handSize(const CharacterData& c) {
+    return sizeof(c.id) +
+            sizeof(uint32_t) + c.name.size() +
+            sizeof(uint32_t) + c.surname.size() +
+            sizeof(uint8_t) +
+            sizeof(uint32_t) + c.bio.size();
+}
+
+void handWriteString(uint8_t*& out, const std::string& str) {
+    uint32_t length = static_cast<uint32_t>(str.size());
+    std::memcpy(out, &length, sizeof(length));
+    out += sizeof(length);
+    std::memcpy(out, str.data(), str.size());
+    out += str.size();
+}
+
+size_t handEncode(const CharacterData& c, uint8_t* out) {
+    uint8_t* position = out;
+    std::memcpy(position, &c.id, sizeof(c.id));
+    position += sizeof(c.id);
+    handWriteString(position, c.name);
+    handWriteString(position, c.surname);
+    *position++ = c.age;
+    handWriteString(position, c.bio);
+    return static_cast<size_t>(position - out);
+}
+
+bool handReadString(const uint8_t* data, size_t size, size_t& offset, std::string_view& value) {
+    uint32_t length = 0;
+    if (size - offset < sizeof(length)) return false;
+    std::memcpy(&length, data + offset, sizeof(length));
+    offset += sizeof(length);
+    if (size - offset < length) return false;
+    value = std::string_view(reinterpret_cast<const char*>(data + offset), length);
+    offset += length;
+    return true;
+}
+
+bool handDecode(const uint8_t* data, size_t size, CharacterView& view) {
+    size_t offset = 0;
+    if (size < sizeof(view.id)) return false;
+    std::memcpy(&view.id, data, sizeof(view.id));
+    offset += sizeof(view.id);
+    if (!handReadString(data, size, offset, view.name)) return false;
+    if (!handReadString(data, size, offset, view.surname)) return false;
+    if (size - offset < 1) return false;
+    view.age = data[offset++];
+    return handReadString(data, size, offset, view.bio);
+}
+
+/// Runs body once per character and iteration, returns nanoseconds per character.
+template<typename Body>
+double measure(size_t iterations, size_t characters, Body body) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        for (size_t c = 0; c < characters; ++c) {
+            body(c);
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (iterations * characters);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t iterations = argc > 1 ? std::stoul(argv[1]) : 2000;
+    size_t count = argc > 2 ? std::stoul(argv[2]) : 1000;
+
+    std::vector<CharacterData> characters(count);
+    for (size_t i = 0; i < count; ++i) {
+        characters[i].id = static_cast<int32_t>(i + 1);
+        characters[i].name = "Name" + std::to_string(i);
+        characters[i].surname = "Surname" + std::to_string(i % 97);
+        characters[i].age = static_cast<uint8_t>(i % 100);
+        characters[i].bio = std::string(32 + i % 200, 'b');
+    }
+
+    // Every character gets a slot big enough for its encoding
+    std::vector<size_t> offsets(count + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        offsets[i + 1] = offsets[i] + handSize(characters[i]);
+    }
+    std::vector<uint8_t> buffer(offsets[count]);
+
+    // Results feed a checksum so the loops cannot be optimized away
+    volatile size_t sink = 0;
+
+    double handSizeNs = measure(iterations, count, [&](size_t c) { sink = sink + handSize(characters[c]); });
+    double layoutSizeNs = measure(iterations, count, [&](size_t c) { sink = sink + CharacterLayout::size(characters[c]); });
+
+    double handEncodeNs = measure(iterations, count, [&](size_t c) {
+        sink = sink + handEncode(characters[c], buffer.data() + offsets[c]);
+    });
+    std::vector<uint8_t> reference = buffer;
+    double layoutEncodeNs = measure(iterations, count, [&](size_t c) {
+        sink = sink + CharacterLayout::encode(characters[c], buffer.data() + offsets[c]);
+    });
+    if (buffer != reference) {
+        std::cerr << "Encodings differ" << std::endl;
+        return 1;
+    }
+
+    double handDecodeNs = measure(iterations, count, [&](size_t c) {
+        CharacterView view;
+        handDecode(buffer.data() + offsets[c], offsets[c + 1] - offsets[c], view);
+        sink = sink + view.bio.size();
+    });
+    double layoutDecodeNs = measure(iterations, count, [&](size_t c) {
+        CharacterView view;
+        CharacterViewLayout::decode(buffer.data() + offsets[c], offsets[c + 1] - offsets[c], view);
+        sink = sink + view.bio.size();
+    });
+
+    std::cout << "iterations=" << iterations << " characters=" << count << std::endl;
+    std::cout << std::setw(10) << "ns/char" << std::setw(14) << "hand-written" << std::setw(12) << "layout" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::setw(10) << "size" << std::setw(14) << handSizeNs << std::setw(12) << layoutSizeNs << std::endl;
+    std::cout << std::setw(10) << "encode" << std::setw(14) << handEncodeNs << std::setw(12) << layoutEncodeNs << std::endl;
+    std::cout << std::setw(10) << "decode" << std::setw(14) << handDecodeNs << std::setw(12) << layoutDecodeNs << std::endl;
+    return 0;
+}
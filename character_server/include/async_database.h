@@ -0,0 +1,245 @@
+/**
+ * \file async_database.h
+ * \brief MySQL access driven by the io_context instead of blocking threads
+ *
+ * This file contains the declaration of the AsyncDatabase class which runs
+ * character queries with the non-blocking client API of MariaDB Connector/C
+ * and waits for the MySQL sockets on the server's io_context.
+ */
+
+#ifndef ASYNCDATABASE_H
+#define ASYNCDATABASE_H
+
+#include <boost/asio.hpp>
+#include <mysql/mysql.h>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "character_cache.h"
+#include "connection_pool.h"
+#include "protocol.h"
+
+/**
+ * \class AsyncDatabase
+ * \brief Non-blocking MySQL executor for the character table
+ *
+ * Every connection runs one query at a time. A query is started with the
+ * mysql_*_start call and, whenever the client library would block, the
+ * socket readiness it waits for is registered on the io_context, where the
+ * matching mysql_*_cont call resumes it. No thread is held during a round
+ * trip, so the number of queries in flight is bounded by the connection
+ * count instead of the number of worker threads. Queries arriving while all
+ * connections are busy wait in a FIFO queue.
+ *
+ * All state lives on one strand of the io_context. Completion handlers run
+ * on that strand and must not block.
+ *
+ * Reads and writes go through the same CharacterCache as the
+ * DatabaseManager, so both execution modes stay coherent.
+ *
+ * \note Needs the non-blocking API of MariaDB Connector/C and POSIX
+ *       descriptors, it is only built when both are available.
+ */
+class AsyncDatabase {
+public:
+    /// Receives the result of a single character lookup.
+    using CharacterHandler = std::function<void(std::optional<CharacterData>)>;
+
+    /// Receives all characters, empty optional if the query failed.
+    using CharactersHandler = std::function<void(std::optional<std::vector<CharacterData>>)>;
+
+    /// Receives whether a write succeeded.
+    using StatusHandler = std::function<void(bool)>;
+
+    /// Delay before a failed connection is opened again.
+    static constexpr std::chrono::seconds RECONNECT_DELAY{1};
+
+    /**
+     * \brief Constructs an executor on an io_context, call initialize() before use
+     * \param ioContext Context waiting for the MySQL sockets
+     * \param cache Character cache shared with the DatabaseManager
+     */
+    AsyncDatabase(boost::asio::io_context& ioContext, CharacterCache& cache);
+
+    /**
+     * \brief Destructor that closes all connections
+     */
+    ~AsyncDatabase();
+
+    // Prevent copying and assignment
+    AsyncDatabase(const AsyncDatabase&) = delete;
+    AsyncDatabase& operator=(const AsyncDatabase&) = delete;
+
+    /**
+     * \brief Starts connecting, connections become usable as they come up
+     * \param settings Connection parameters, size is the number of connections
+     */
+    void initialize(const ConnectionPool::Settings& settings);
+
+    /**
+     * \brief Looks up a character, from the cache if possible
+     * \param id ID of the character
+     * \param handler Receives the character, empty optional if not found or on error
+     * \note On a cache hit the handler runs before this call returns.
+     */
+    void getCharacter(int32_t id, CharacterHandler handler);
+
+    /**
+     * \brief Retrieves all characters
+     * \param handler Receives the characters
+     */
+    void getAllCharacters(CharactersHandler handler);
+
+    /**
+     * \brief Adds a new character, its id is ignored
+     * \param character Character to insert
+     * \param handler Receives whether the row was inserted
+     */
+    void addCharacter(const CharacterData& character, StatusHandler handler);
+
+    /**
+     * \brief Updates an existing character
+     * \param id ID of the character
+     * \param character New values
+     * \param handler Receives whether the statement succeeded
+     */
+    void updateCharacter(int32_t id, const CharacterData& character, StatusHandler handler);
+
+    /**
+     * \brief Deletes a character
+     * \param id ID of the character
+     * \param handler Receives whether the statement succeeded
+     */
+    void deleteCharacter(int32_t id, StatusHandler handler);
+
+private:
+    /**
+     * \struct Query
+     * \brief One queued SQL statement
+     */
+    struct Query {
+        /// Builds the statement text, escaping with the connection that runs it.
+        std::function<std::string(MYSQL*)> sql;
+        /// Called with the stored result (nullptr for statements without one) or ok == false.
+        std::function<void(bool ok, MYSQL* mysql, MYSQL_RES* result)> complete;
+        bool storesResult = false; ///< Whether a result set is fetched after the statement
+    };
+
+    /**
+     * \enum Step
+     * \brief Non-blocking call a connection is in the middle of
+     */
+    enum class Step {
+        Idle, ///< Nothing to resume
+        Connect, ///< mysql_real_connect_start
+        Query, ///< mysql_real_query_start
+        StoreResult ///< mysql_store_result_start
+    };
+
+    /**
+     * \struct Connection
+     * \brief One non-blocking MySQL connection and the operation it runs
+     */
+    struct Connection {
+        explicit Connection(boost::asio::io_context& ioContext);
+
+        MYSQL* mysql = nullptr; ///< MySQL handle, nullptr while closed
+        std::unique_ptr<boost::asio::posix::stream_descriptor> socket; ///< MySQL socket registered on the io_context
+        boost::asio::steady_timer timer; ///< Client library timeouts and reconnect delay
+        Step step = Step::Idle; ///< Call to resume when the socket is ready
+        bool open = false; ///< Connected and able to run queries
+        uint64_t waitId = 0; ///< Identifies the current wait, stale wakeups are ignored
+        int queryError = 0; ///< Result of mysql_real_query
+        MYSQL_RES* result = nullptr; ///< Result of mysql_store_result
+        MYSQL* connected = nullptr; ///< Result of mysql_real_connect
+        std::string sql; ///< Statement text, must outlive the query
+        Query query; ///< Query being run
+    };
+
+    /**
+     * \brief Queues a query and starts it if a connection is free
+     * \param query Query to run
+     * \note May be called from any thread, the query is queued on m_strand.
+     */
+    void submit(Query query);
+
+    /**
+     * \brief Starts the oldest queued query on an idle connection
+     * \param connection Connection that just became idle
+     */
+    void dispatch(Connection& connection);
+
+    /**
+     * \brief Starts opening a connection
+     * \param connection Closed connection
+     */
+    void connect(Connection& connection);
+
+    /**
+     * \brief Advances the connection after a non-blocking call returned
+     * \param connection Connection to advance
+     * \param status Wait flags returned by the call, 0 once it finished
+     */
+    void proceed(Connection& connection, int status);
+
+    /**
+     * \brief Registers the readiness a non-blocking call waits for
+     * \param connection Connection waiting
+     * \param status MYSQL_WAIT_* flags returned by the call
+     */
+    void wait(Connection& connection, int status);
+
+    /**
+     * \brief Resumes the pending call of a connection
+     * \param connection Connection to resume
+     * \param ready MYSQL_WAIT_* flags that became ready
+     */
+    void resume(Connection& connection, int ready);
+
+    /**
+     * \brief Completes the current query and picks the next one
+     * \param connection Connection that ran the query
+     * \param ok Whether the query succeeded
+     */
+    void finish(Connection& connection, bool ok);
+
+    /**
+     * \brief Closes a connection and schedules opening it again
+     * \param connection Connection to reset
+     */
+    void reconnectLater(Connection& connection);
+
+    /**
+     * \brief Fails every queued query when no connection is usable
+     */
+    void failPendingIfDisconnected();
+
+    /**
+     * \brief Closes the MySQL handle without closing the socket twice
+     * \param connection Connection to close
+     */
+    static void closeConnection(Connection& connection);
+
+    /**
+     * \brief Appends a string literal with its quotes to a statement
+     * \param sql Statement text to append to
+     * \param mysql Connection whose character set is used for escaping
+     * \param value Unescaped value
+     */
+    static void appendQuoted(std::string& sql, MYSQL* mysql, const std::string& value);
+
+    boost::asio::io_context& m_ioContext; ///< Context waiting for the sockets
+    boost::asio::strand<boost::asio::io_context::executor_type> m_strand; ///< Serializes all state below
+    CharacterCache& m_cache; ///< Cache shared with the DatabaseManager
+    ConnectionPool::Settings m_settings; ///< Connection parameters
+    std::vector<std::unique_ptr<Connection>> m_connections; ///< All connections
+    std::deque<Query> m_pending; ///< Queries waiting for a connection
+    size_t m_connectedCount = 0; ///< Connections that are open
+};
+
+#endif // ASYNCDATABASE_H
@@ -0,0 +1,127 @@
+/**
+ * \file character_cache.h
+ * \brief Sharded, size-bounded LRU cache of characters keyed by id
+ */
+
+#ifndef CHARACTERCACHE_H
+#define CHARACTERCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "protocol.h"
+
+/**
+ * \class CharacterCache
+ * \brief Thread-safe least-recently-used cache of CharacterData
+ *
+ * Entries are spread over independently locked shards by id, so lookups of
+ * different ids rarely contend. Each shard evicts its least recently used
+ * entries once the estimated memory of its entries exceeds its share of the
+ * byte capacity.
+ *
+ * A read-through caller takes a load token with beginLoad() before querying
+ * the database and passes it to fill(). If the id was invalidated in the
+ * meantime, fill() drops the possibly stale value.
+ */
+class CharacterCache {
+public:
+    /**
+     * \struct Stats
+     * \brief Snapshot of cache counters
+     */
+    struct Stats {
+        uint64_t hits = 0; ///< Lookups answered from the cache
+        uint64_t misses = 0; ///< Lookups that had to go to the database
+        uint64_t evictions = 0; ///< Entries dropped to stay within capacity
+        size_t entries = 0; ///< Entries currently cached
+        size_t bytes = 0; ///< Estimated memory of the cached entries
+    };
+
+    /**
+     * \brief Constructs an empty cache
+     * \param capacityBytes Total memory budget for cached entries
+     * \param shardCount Number of independently locked shards
+     */
+    CharacterCache(size_t capacityBytes, size_t shardCount);
+
+    // Prevent copying and assignment
+    CharacterCache(const CharacterCache&) = delete;
+    CharacterCache& operator=(const CharacterCache&) = delete;
+
+    /**
+     * \brief Looks up a character and marks it as recently used
+     * \param id ID of the character
+     * \param countMiss Count a miss, false for probes followed by a regular lookup
+     * \return Cached character, empty optional on a miss
+     */
+    std::optional<CharacterData> get(int32_t id, bool countMiss = true);
+
+    /**
+     * \brief Takes a token before loading a missed id from the database
+     * \param id ID that is about to be loaded
+     * \return Token to pass to fill()
+     */
+    uint64_t beginLoad(int32_t id);
+
+    /**
+     * \brief Caches a character loaded from the database
+     * \param character Loaded character
+     * \param token Token returned by beginLoad() for the same id
+     * \note The value is dropped if the id was invalidated after beginLoad().
+     */
+    void fill(const CharacterData& character, uint64_t token);
+
+    /**
+     * \brief Removes a character that was changed or deleted
+     * \param id ID of the character
+     */
+    void invalidate(int32_t id);
+
+    /**
+     * \brief Gets the current cache counters
+     * \return Counter snapshot
+     */
+    Stats stats() const;
+
+private:
+    /**
+     * \struct Shard
+     * \brief One independently locked LRU list
+     */
+    struct Shard {
+        std::mutex mutex; ///< Protects all members of the shard
+        std::list<CharacterData> lru; ///< Entries, most recently used first
+        std::unordered_map<int32_t, std::list<CharacterData>::iterator> index; ///< id to entry
+        size_t bytes = 0; ///< Estimated memory of the entries
+        uint64_t invalidations = 0; ///< Bumped by every invalidate(), used as load token
+    };
+
+    /**
+     * \brief Gets the shard responsible for an id
+     * \param id ID of a character
+     * \return Shard owning the id
+     */
+    Shard& shardFor(int32_t id) const;
+
+    /**
+     * \brief Estimates the memory used by one cached entry
+     * \param character Cached character
+     * \return Estimated size in bytes, including container overhead
+     */
+    static size_t entrySize(const CharacterData& character);
+
+    std::vector<std::unique_ptr<Shard>> m_shards; ///< Shards, indexed by id hash
+    size_t m_shardCapacity = 0; ///< Byte budget of one shard
+    std::atomic<uint64_t> m_hits{0}; ///< Lookups answered from the cache
+    std::atomic<uint64_t> m_misses{0}; ///< Lookups not found in the cache
+    std::atomic<uint64_t> m_evictions{0}; ///< Entries evicted for capacity
+};
+
+#endif // CHARACTERCACHE_H
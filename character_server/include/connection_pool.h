@@ -0,0 +1,186 @@
+/**
+ * \file connection_pool.h
+ * \brief Bounded pool of MySQL connections with checkout/return semantics
+ *
+ * This file contains the declaration of the ConnectionPool class which keeps a
+ * fixed number of MySQL connections open and hands them out to worker threads
+ * one at a time, so database work can run in parallel instead of queuing
+ * behind a single connection.
+ */
+
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include <mysql/mysql.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "statement_cache.h"
+
+/**
+ * \class ConnectionPool
+ * \brief Thread-safe pool of MySQL connections
+ *
+ * Connections are checked out with acquire() and returned automatically when
+ * the returned Handle goes out of scope. A connection that has been idle for
+ * longer than the health check interval is pinged before being handed out,
+ * and a connection that failed a ping or was marked broken is reconnected.
+ * Every connection carries its own StatementCache, which is dropped and
+ * rebuilt whenever the connection is reopened.
+ */
+class ConnectionPool {
+public:
+    /**
+     * \struct Settings
+     * \brief Connection parameters and pool limits
+     */
+    struct Settings {
+        std::string host{}; ///< MySQL server hostname or IP address
+        std::string user{}; ///< MySQL username
+        std::string pass{}; ///< MySQL password
+        std::string db{}; ///< Database name to connect to
+        size_t size = 1; ///< Number of connections kept open
+        std::chrono::milliseconds acquireTimeout{5'000}; ///< Maximum wait for a free connection
+        std::chrono::milliseconds healthCheckInterval{30'000}; ///< Idle time after which a connection is pinged
+    };
+
+private:
+    /**
+     * \struct Connection
+     * \brief One pooled MySQL connection and its bookkeeping
+     */
+    struct Connection {
+        MYSQL* mysql = nullptr; ///< MySQL connection, nullptr while disconnected
+        std::unique_ptr<StatementCache> statements{}; ///< Prepared statements of this connection
+        std::chrono::steady_clock::time_point lastUsed{}; ///< Time the connection was last returned
+        bool broken = false; ///< Set when a query failed because the link was lost
+    };
+
+public:
+    /**
+     * \class Handle
+     * \brief RAII checkout of a pooled connection
+     *
+     * The connection is returned to the pool when the handle is destroyed.
+     * An empty handle (no free connection within the timeout, or the pool
+     * could not reconnect) converts to false.
+     */
+    class Handle {
+    public:
+        Handle() = default;
+        ~Handle();
+
+        Handle(Handle&& other) noexcept;
+        Handle& operator=(Handle&& other) noexcept;
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        /**
+         * \brief Gets the underlying MySQL connection
+         * \return MySQL connection, nullptr for an empty handle
+         */
+        MYSQL* get() const { return m_connection ? m_connection->mysql : nullptr; }
+
+        /**
+         * \brief Checks whether the handle holds a connection
+         */
+        explicit operator bool() const { return m_connection != nullptr; }
+
+        /**
+         * \brief Gets the prepared statement cache of the connection
+         * \return Statement cache, created on first use
+         */
+        StatementCache& statements();
+
+        /**
+         * \brief Inspects the last error and marks the connection for reconnect
+         *        if the server link was lost
+         * \param stmt Statement that failed, nullptr to inspect the connection error
+         */
+        void checkError(MYSQL_STMT* stmt = nullptr);
+
+    private:
+        friend class ConnectionPool;
+
+        Handle(ConnectionPool* pool, Connection* connection)
+            : m_pool(pool), m_connection(connection) {}
+
+        /// Returns the connection to the pool.
+        void release();
+
+        ConnectionPool* m_pool = nullptr; ///< Owning pool
+        Connection* m_connection = nullptr; ///< Checked out connection
+    };
+
+    ConnectionPool() = default;
+
+    /**
+     * \brief Destructor that closes all connections
+     */
+    ~ConnectionPool();
+
+    // Prevent copying and assignment
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    /**
+     * \brief Opens all connections of the pool
+     * \param settings Connection parameters and pool size
+     * \return true if every connection was established, false otherwise
+     * \note Any previously opened connections are closed first, so no handle
+     *       may be outstanding when this is called.
+     */
+    bool initialize(const Settings& settings);
+
+    /**
+     * \brief Closes all connections of the pool
+     */
+    void shutdown();
+
+    /**
+     * \brief Checks out a connection, waiting up to the acquire timeout
+     * \return Handle holding a healthy connection, or an empty handle
+     * \note This method is thread-safe
+     */
+    Handle acquire();
+
+    /**
+     * \brief Gets the number of connections in the pool
+     * \return Pool size
+     */
+    size_t size() const { return m_connections.size(); }
+
+private:
+    /**
+     * \brief Opens (or reopens) the MySQL link of a connection
+     * \param connection Connection to open
+     * \return true if the connection was established, false otherwise
+     */
+    bool connect(Connection& connection);
+
+    /**
+     * \brief Pings idle or broken connections and reconnects them if needed
+     * \param connection Connection to verify
+     * \return true if the connection is usable, false otherwise
+     */
+    bool ensureHealthy(Connection& connection);
+
+    /**
+     * \brief Puts a connection back on the idle list
+     * \param connection Connection being returned
+     */
+    void release(Connection* connection);
+
+    Settings m_settings{}; ///< Connection parameters
+    std::vector<std::unique_ptr<Connection>> m_connections; ///< All connections owned by the pool
+    std::vector<Connection*> m_idle; ///< Connections available for checkout
+    std::mutex m_mutex; ///< Protects m_idle
+    std::condition_variable m_available; ///< Signalled when a connection is returned
+};
+
+#endif // CONNECTIONPOOL_H
@@ -4,17 +4,21 @@
  *
  * This file contains the declaration of the DatabaseManager class which provides
  * a thread-safe interface for MySQL database operations related to character management.
+ * Operations run on connections checked out from a ConnectionPool, so concurrent
+ * requests do not serialize on a single MySQL connection.
  */
 
 #ifndef DATABASEMANAGER_H
 #define DATABASEMANAGER_H
 
 #include <mysql/mysql.h>
-#include <mutex>
 #include <optional>
 #include <vector>
 
+#include "character_cache.h"
+#include "connection_pool.h"
 #include "protocol.h"
+#include "storage_backend.h"
 
 /**
  * \class DatabaseManager
@@ -22,9 +26,10 @@
  *
  * This class provides a thread-safe interface for performing CRUD operations
  * on character data in a MySQL database. It implements the singleton pattern
- * to ensure only one instance exists throughout the application.
+ * to ensure only one instance exists throughout the application, and is the
+ * MySQL implementation of StorageBackend.
  */
-class DatabaseManager {
+class DatabaseManager : public StorageBackend {
 public:
     /**
      * \brief Gets the singleton instance of DatabaseManager
@@ -33,22 +38,42 @@ public:
     static DatabaseManager& getInstance();
 
     /**
-     * \brief Initializes the database connection
+     * \brief Initializes the database connection pool
      * \param host MySQL server hostname or IP address
      * \param user MySQL username
      * \param pass MySQL password
      * \param db Database name to connect to
+     * \param poolSize Number of MySQL connections to keep open
      * \return true if connection was successful, false otherwise
      */
     bool initialize(const std::string& host, const std::string& user,
-                   const std::string& pass, const std::string& db);
+                   const std::string& pass, const std::string& db,
+                   size_t poolSize = Protocol::DB_POOL_SIZE);
 
     /**
      * \brief Adds a new character to the database
      * \param character CharacterData object containing character information
      * \return true if operation was successful, false otherwise
      */
-    bool addCharacter(const CharacterData& character);
+    bool addCharacter(const CharacterData& character) override;
+
+    /**
+     * \brief Adds a new character to the database, binding the parameters to the view
+     * \param character View of the character information
+     * \return true if operation was successful, false otherwise
+     */
+    bool addCharacter(const CharacterView& character) override;
+
+    /**
+     * \brief Adds many characters to the database in one transaction
+     * \param characters Characters to insert, their ids are ignored
+     * \return Generated ids in the order of the input, empty optional if the
+     *         transaction was rolled back
+     * \note Rows are written with multi-row INSERTs of up to
+     *       StatementCache::BATCH_INSERT_ROWS rows each when the server hands
+     *       out consecutive ids for them, one INSERT per row otherwise.
+     */
+    std::optional<std::vector<int32_t>> addCharacters(const std::vector<CharacterData>& characters) override;
 
     /**
      * \brief Updates an existing character in the database
@@ -56,27 +81,93 @@ public:
      * \param character CharacterData object with updated information
      * \return true if operation was successful, false otherwise
      */
-    bool updateCharacter(int id, const CharacterData& character);
+    bool updateCharacter(int id, const CharacterData& character) override;
+
+    /**
+     * \brief Updates an existing character, binding the parameters to the view
+     * \param id ID of the character to update
+     * \param character View of the updated information
+     * \return true if operation was successful, false otherwise
+     */
+    bool updateCharacter(int id, const CharacterView& character) override;
 
     /**
      * \brief Deletes a character from the database
      * \param id ID of the character to delete
      * \return true if operation was successful, false otherwise
      */
-    bool deleteCharacter(int id);
+    bool deleteCharacter(int id) override;
 
     /**
      * \brief Retrieves all characters from the database
      * \return Vector of CharacterData objects for all characters
      */
-    std::vector<CharacterData> getAllCharacters();
+    std::vector<CharacterData> getAllCharacters() override;
 
     /**
-     * \brief Retrieves a specific character from the database
+     * \brief Streams all characters from the database in serialized chunks
+     * \param chunkSize Payload size after which a chunk is handed to the sink
+     * \param sink Callback receiving every non-empty chunk in order
+     * \return true if every row was streamed, false on error or if the sink stopped
+     * \note Rows are fetched unbuffered with mysql_use_result, so memory stays
+     *       bounded by the chunk size whatever the table size. The pooled
+     *       connection is held until the stream ends, a slow sink keeps it busy.
+     */
+    bool streamAllCharacters(size_t chunkSize, const ChunkSink& sink) override;
+
+    /**
+     * \brief Retrieves a specific character from the cache or the database
      * \param id ID of the character to retrieve
      * \return Optional containing CharacterData if found, empty optional otherwise
+     * \note Cache hits are served without checking out a connection.
      */
-    std::optional<CharacterData> getCharacter(int id);
+    std::optional<CharacterData> getCharacter(int id) override;
+
+    /**
+     * \brief Retrieves a character if it is cached
+     * \param id ID of the character to retrieve
+     * \param character Receives the cached character
+     * \return true on a cache hit, false if the database has to be asked
+     */
+    bool tryGetCharacter(int id, std::optional<CharacterData>& character) override;
+
+    /**
+     * \brief Retrieves several characters from the cache or the database
+     * \param ids IDs of the characters to retrieve, duplicates allowed
+     * \return One entry per id in the order of ids, empty optional if not found
+     * \note Cache misses are loaded with a single WHERE id IN (...) query.
+     */
+    std::vector<std::optional<CharacterData>> getCharacters(const std::vector<int32_t>& ids) override;
+
+    /**
+     * \brief Retrieves one page of characters ordered by id
+     * \param afterId Only ids past this one in the requested order are returned,
+     *        empty optional to start at the first id
+     * \param limit Maximum number of characters
+     * \param descending Order by descending instead of ascending id
+     * \return Up to limit characters in the requested order
+     * \throw std::runtime_error if the connection or the query fails
+     * \note Served by a primary key range scan, so the cost depends on the
+     *       page size and not on the table size.
+     */
+    std::vector<CharacterData> getCharacterRange(std::optional<int32_t> afterId,
+                                                 size_t limit, bool descending) override;
+
+    /**
+     * \brief Gets the hit/miss counters of the character cache
+     * \return Snapshot of the cache statistics
+     */
+    CharacterCache::Stats cacheStats() const { return m_cache.stats(); }
+
+    /**
+     * \brief Gets the character cache, for other executors on the same table
+     * \return Character cache
+     */
+    CharacterCache& cache() { return m_cache; }
+
+protected:
+    bool readStreamPage(std::optional<int32_t> afterId, size_t limit,
+                        std::vector<CharacterData>& page) override;
 
 private:
     /**
@@ -85,9 +176,9 @@ private:
     DatabaseManager() = default;
 
     /**
-     * \brief Destructor that cleans up database connection
+     * \brief Destructor that closes the pooled database connections
      */
-    ~DatabaseManager();
+    ~DatabaseManager() override;
 
     // Prevent copying and assignment
     DatabaseManager(const DatabaseManager&) = delete;
@@ -101,14 +192,49 @@ private:
      */
     bool executeQuery(const std::string& query);
 
+    /**
+     * \brief Reads how the server generates AUTO_INCREMENT ids
+     * \return true if the settings were read, false keeps per-row inserts
+     */
+    bool loadAutoIncrementSettings();
+
+    /**
+     * \brief Reads one page of characters ordered by id
+     * \param afterId Only ids past this one in the requested order are returned,
+     *        empty optional to start at the first id
+     * \param limit Maximum number of characters
+     * \param descending Order by descending instead of ascending id
+     * \param characters Receives up to limit characters in the requested order
+     * \return false if the query failed
+     */
+    bool selectRange(std::optional<int32_t> afterId, size_t limit, bool descending,
+                     std::vector<CharacterData>& characters);
+
+    /**
+     * \brief Executes a cached prepared statement with its bound parameters
+     * \param connection Checked out connection the statement belongs to
+     * \param id Statement to execute, its parameters must already point at the data
+     * \return Executed statement, nullptr if preparing or executing failed
+     */
+    MYSQL_STMT* execute(ConnectionPool::Handle& connection, StatementCache::Id id);
+
+    /*!
+     * \brief Pool of MySQL connections shared by all operations
+     */
+    ConnectionPool m_pool;
+    /*!
+     * \brief Read-through cache of getCharacter results
+     */
+    CharacterCache m_cache{Protocol::CACHE_CAPACITY_BYTES, Protocol::CACHE_SHARDS};
     /*!
-     * \brief MySQL connection
+     * \brief Distance between generated ids, \@\@auto_increment_increment
      */
-    MYSQL* m_connection = nullptr;
+    int32_t m_autoIncrementStep = 1;
     /*!
-     * \brief Mutex for thread-safe database access
+     * \brief Multi-row INSERTs get ids m_autoIncrementStep apart, false with
+     *        innodb_autoinc_lock_mode=2 or if unknown
      */
-    std::mutex m_dbMutex;
+    bool m_consecutiveIds = false;
 };
 
 #endif // DATABASEMANAGER_H
@@ -0,0 +1,234 @@
+/**
+ * \file log_storage.h
+ * \brief Embedded character storage engine on a local append-only log
+ *
+ * This file contains the declaration of the LogStorage class, a StorageBackend
+ * that keeps characters in a write-ahead log file on local disk, so a node can
+ * serve and persist data without a MySQL server.
+ */
+
+#ifndef LOGSTORAGE_H
+#define LOGSTORAGE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "storage_backend.h"
+
+/**
+ * \class LogStorage
+ * \brief Append-only log StorageBackend with an in-memory index
+ *
+ * Every change appends one record to the log: the CharacterData::serialize
+ * bytes of the new version, or the id of a deleted character. An in-memory
+ * index maps every live id to the offset of its latest record, so reads are
+ * a single positioned read.
+ *
+ * Writers return once their record is on disk. A background thread fsyncs the
+ * log for all writers waiting at that moment (group commit), so concurrent
+ * writes share one fsync. Another background thread periodically rewrites
+ * the log without superseded records once they make up most of the file.
+ * At startup the log is replayed to rebuild the index, and a torn record left
+ * by a crash is truncated away.
+ *
+ * \note Uses POSIX file I/O and is only built on UNIX platforms.
+ */
+class LogStorage : public StorageBackend {
+public:
+    /// Name of the log file inside the data directory.
+    static constexpr const char* LOG_FILE_NAME = "characters.log";
+
+    /// Time between checks whether the log should be compacted.
+    static constexpr std::chrono::seconds COMPACTION_INTERVAL{60};
+
+    /// Logs smaller than this are never compacted.
+    static constexpr uint64_t COMPACTION_MIN_BYTES = 16 * 1024 * 1024;
+
+    /**
+     * \brief Constructs a storage on a data directory, call open() before use
+     * \param directory Directory holding the log file, created if missing
+     */
+    explicit LogStorage(const std::string& directory);
+
+    /**
+     * \brief Destructor that stops the background threads and syncs the log
+     */
+    ~LogStorage() override;
+
+    // Prevent copying and assignment
+    LogStorage(const LogStorage&) = delete;
+    LogStorage& operator=(const LogStorage&) = delete;
+
+    /**
+     * \brief Opens the log, replays it and starts the background threads
+     * \return true if the log is ready, false on an I/O error or a foreign file
+     */
+    bool open();
+
+    /**
+     * \brief Rewrites the log keeping only the latest record of every live id
+     * \return true if the log was compacted, false on an I/O error
+     * \note The rewritten file is synced before the storage is locked. Readers
+     *       and writers are only blocked while the records appended during
+     *       the rewrite are copied over and synced and the file is swapped in.
+     */
+    bool compact();
+
+    bool addCharacter(const CharacterData& character) override;
+    std::optional<std::vector<int32_t>> addCharacters(const std::vector<CharacterData>& characters) override;
+    bool updateCharacter(int id, const CharacterData& character) override;
+    bool deleteCharacter(int id) override;
+    std::vector<CharacterData> getAllCharacters() override;
+    bool streamAllCharacters(size_t chunkSize, const ChunkSink& sink) override;
+    std::optional<CharacterData> getCharacter(int id) override;
+    std::vector<CharacterData> getCharacterRange(std::optional<int32_t> afterId,
+                                                 size_t limit, bool descending) override;
+
+private:
+    /**
+     * \enum RecordType
+     * \brief Kind of a log record
+     */
+    enum RecordType : uint8_t {
+        RECORD_PUT = 1, ///< Payload is the serialized character
+        RECORD_DELETE = 2 ///< Payload is the int32 id of the deleted character
+    };
+
+    /**
+     * \struct Location
+     * \brief Position of a record in the log file
+     */
+    struct Location {
+        uint64_t offset = 0; ///< Offset of the record header
+        uint32_t size = 0; ///< Record size including its header
+    };
+
+    /**
+     * \brief Appends one encoded record to a buffer
+     * \param buffer Buffer to append to
+     * \param type Record type
+     * \param payload Record payload
+     * \param size Payload size in bytes
+     * \return Encoded record size
+     */
+    static uint32_t encodeRecord(std::vector<uint8_t>& buffer, RecordType type,
+                                 const uint8_t* payload, uint32_t size);
+
+    /**
+     * \brief Computes the checksum stored in a record header
+     * \param type Record type
+     * \param payload Record payload
+     * \param size Payload size in bytes
+     * \return FNV-1a hash of the type and the payload
+     */
+    static uint32_t checksum(RecordType type, const uint8_t* payload, uint32_t size);
+
+    /**
+     * \brief Writes encoded records at the end of the log
+     * \param records Encoded records
+     * \param lsn Receives the log sequence number to wait for with waitDurable()
+     * \return true if all bytes were written, false otherwise or after a failed sync
+     * \note The caller holds m_mutex exclusively.
+     */
+    bool append(const std::vector<uint8_t>& records, uint64_t& lsn);
+
+    /**
+     * \brief Checks that a number of new ids still fits into int32_t
+     * \param count Number of characters about to be added
+     * \return true if the ids are available, false once they are exhausted
+     * \note The caller holds m_mutex exclusively.
+     */
+    bool idsAvailable(size_t count);
+
+    /**
+     * \brief Blocks until the log is synced up to a sequence number
+     * \param lsn Sequence number returned by append()
+     * \return true once durable, false if syncing the log failed
+     */
+    bool waitDurable(uint64_t lsn);
+
+    /**
+     * \brief Points the index at a new record of an id
+     * \param id ID of the character
+     * \param location Location of its latest record
+     * \note The caller holds m_mutex exclusively.
+     */
+    void setLocation(int32_t id, const Location& location);
+
+    /**
+     * \brief Removes an id from the index
+     * \param it Index entry of the id
+     * \note The caller holds m_mutex exclusively.
+     */
+    void eraseLocation(std::unordered_map<int32_t, Location>::iterator it);
+
+    /**
+     * \brief Reads and verifies a character record
+     * \param fd Log file descriptor to read from
+     * \param location Location of a PUT record
+     * \return Stored character, empty optional on an I/O or checksum error
+     */
+    static std::optional<CharacterData> readCharacter(int fd, const Location& location);
+
+    /**
+     * \brief Copies the index and a duplicate of the log descriptor
+     * \param fd Receives a descriptor the caller must close
+     * \return Locations of all live records, sorted by offset
+     */
+    std::vector<Location> snapshotLocations(int& fd) const;
+
+    /**
+     * \brief Rebuilds the index by replaying the log
+     * \return true if the log was read, false on an I/O error or a foreign file
+     */
+    bool recover();
+
+    /**
+     * \brief Writes the file header
+     * \param fd Log file descriptor
+     * \param nextId Lowest id new characters may get, survives compaction
+     * \return true if written, false otherwise
+     */
+    static bool writeHeader(int fd, int64_t nextId);
+
+    /// Group commit loop of the flush thread.
+    void flushLoop();
+
+    /// Periodic compaction loop of the compaction thread.
+    void compactionLoop();
+
+    std::string m_directory; ///< Data directory
+    std::string m_path; ///< Path of the log file
+
+    mutable std::shared_mutex m_mutex; ///< Protects the file, the index and the counters below
+    int m_fd = -1; ///< Log file descriptor
+    uint64_t m_fileSize = 0; ///< Bytes of valid log
+    uint64_t m_liveBytes = 0; ///< Bytes of records the index points to
+    uint64_t m_appendedBytes = 0; ///< Bytes appended since open, the log sequence number
+    std::unordered_map<int32_t, Location> m_index; ///< Latest record of every live id
+    std::set<int32_t> m_order; ///< Ids of m_index in ascending order, serves getCharacterRange()
+    int64_t m_nextId = 1; ///< Next id to hand out, like AUTO_INCREMENT, wider than an id to hold INT32_MAX + 1
+
+    std::mutex m_syncMutex; ///< Protects the group commit state below
+    std::condition_variable m_syncRequested; ///< Wakes the flush thread
+    std::condition_variable m_synced; ///< Wakes writers after a sync
+    uint64_t m_requestedLsn = 0; ///< Highest sequence number a writer waits for
+    uint64_t m_durableLsn = 0; ///< Sequence number synced to disk
+    bool m_syncFailed = false; ///< Set once fsync failed, the log is no longer trusted
+    bool m_stopping = false; ///< Stops the background threads
+
+    std::mutex m_compactionMutex; ///< Allows one compaction at a time
+    std::condition_variable m_compactionWakeup; ///< Interrupts the compaction wait on shutdown
+    std::thread m_flushThread; ///< Runs flushLoop()
+    std::thread m_compactionThread; ///< Runs compactionLoop()
+};
+
+#endif // LOGSTORAGE_H
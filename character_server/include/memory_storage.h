@@ -0,0 +1,76 @@
+/**
+ * \file memory_storage.h
+ * \brief In-memory character storage engine
+ *
+ * This file contains the declaration of the MemoryStorage class, a
+ * StorageBackend that keeps all characters in process memory. It lets the
+ * server run without a MySQL instance, e.g. as a pure cache tier or to
+ * benchmark the network path in isolation. Data is lost on restart.
+ */
+
+#ifndef MEMORYSTORAGE_H
+#define MEMORYSTORAGE_H
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "storage_backend.h"
+
+/**
+ * \class MemoryStorage
+ * \brief Lock-striped in-memory StorageBackend
+ *
+ * Characters are spread over stripes by id. Each stripe has its own
+ * reader/writer lock, so operations on different ids rarely contend and
+ * reads of the same stripe run in parallel. A separate ordered set of the
+ * ids serves pages in id order, only adds and deletes update it. Its lock
+ * is always taken before a stripe lock.
+ */
+class MemoryStorage : public StorageBackend {
+public:
+    /**
+     * \brief Constructs an empty store
+     * \param stripeCount Number of independently locked stripes
+     */
+    explicit MemoryStorage(size_t stripeCount = Protocol::MEMORY_STORAGE_STRIPES);
+
+    bool addCharacter(const CharacterData& character) override;
+    std::optional<std::vector<int32_t>> addCharacters(const std::vector<CharacterData>& characters) override;
+    bool updateCharacter(int id, const CharacterData& character) override;
+    bool deleteCharacter(int id) override;
+    std::vector<CharacterData> getAllCharacters() override;
+    bool streamAllCharacters(size_t chunkSize, const ChunkSink& sink) override;
+    std::optional<CharacterData> getCharacter(int id) override;
+    bool tryGetCharacter(int id, std::optional<CharacterData>& character) override;
+    bool hasNonBlockingWrites() const override { return true; }
+    std::vector<CharacterData> getCharacterRange(std::optional<int32_t> afterId,
+                                                 size_t limit, bool descending) override;
+
+private:
+    /**
+     * \struct Stripe
+     * \brief One independently locked part of the store
+     */
+    struct Stripe {
+        mutable std::shared_mutex mutex; ///< Protects characters
+        std::unordered_map<int32_t, CharacterData> characters; ///< Characters by id
+    };
+
+    /**
+     * \brief Gets the stripe responsible for an id
+     * \param id ID of a character
+     * \return Stripe owning the id
+     */
+    Stripe& stripeFor(int32_t id);
+
+    std::vector<std::unique_ptr<Stripe>> m_stripes; ///< Stripes, indexed by id
+    mutable std::shared_mutex m_orderMutex; ///< Protects m_order, adds and deletes hold it across their stripe update
+    std::set<int32_t> m_order; ///< Ids of all stored characters in ascending order
+    std::atomic<int32_t> m_nextId{1}; ///< Next id to hand out, like AUTO_INCREMENT
+};
+
+#endif // MEMORYSTORAGE_H
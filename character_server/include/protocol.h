@@ -7,8 +7,14 @@
 #define PROTOCOL_H
 
 #include <cstdint>
+#include <optional>
 #include <vector>
 #include <string>
+#include <string_view>
+
+#include "wire_format.h"
+
+struct CharacterView;
 
 /**
  * \struct CharacterData
@@ -27,6 +33,21 @@ struct CharacterData {
      */
     std::vector<uint8_t> serialize() const;
 
+    /**
+     * \brief Gets the exact size of the serialized character.
+     * \param mode Wire encoding.
+     * \return Number of bytes serializeTo() produces, serialize() for the fixed encoding.
+     */
+    size_t serializedSize(Wire::Mode mode = Wire::Mode::Fixed) const;
+
+    /**
+     * \brief Serializes the character in place.
+     * \param out Receives serializedSize(mode) bytes.
+     * \param mode Wire encoding.
+     * \return Number of bytes written.
+     */
+    size_t serializeTo(uint8_t* out, Wire::Mode mode = Wire::Mode::Fixed) const;
+
     /**
      * \brief Deserializes a byte vector into a CharacterData object.
      * \param data A vector of bytes containing serialized character data.
@@ -34,6 +55,12 @@ struct CharacterData {
      */
     static CharacterData deserialize(const std::vector<uint8_t>& data);
 
+    /**
+     * \brief Gets a view of the character's fields.
+     * \return View pointing into this object, valid while it is unchanged.
+     */
+    CharacterView view() const;
+
     /**
      * \brief Serializes a vector of CharacterData objects into a byte vector.
      * \param characters A vector of CharacterData objects to serialize.
@@ -41,29 +68,95 @@ struct CharacterData {
      */
     static std::vector<uint8_t> serializeVector(const std::vector<CharacterData>& characters);
 
+    /**
+     * \brief Gets the exact size of a serialized vector of characters.
+     * \param characters The characters to serialize.
+     * \param mode Wire encoding, it also applies to the count and size prefixes.
+     * \return Number of bytes serializeVectorTo() produces, serializeVector() for the fixed encoding.
+     */
+    static size_t serializedVectorSize(const std::vector<CharacterData>& characters,
+                                       Wire::Mode mode = Wire::Mode::Fixed);
+
+    /**
+     * \brief Serializes a vector of characters in place.
+     * \param characters The characters to serialize.
+     * \param out Receives serializedVectorSize(characters, mode) bytes.
+     * \param mode Wire encoding, it also applies to the count and size prefixes.
+     * \return Number of bytes written.
+     * \note Lets a response prefix and the characters share one buffer.
+     */
+    static size_t serializeVectorTo(const std::vector<CharacterData>& characters, uint8_t* out,
+                                    Wire::Mode mode = Wire::Mode::Fixed);
+
+    /**
+     * \brief Appends the character as one size-prefixed element of a serialized vector.
+     * \param buffer The buffer to append to.
+     * \note The caller keeps the element count in front of the elements up to date.
+     */
+    void appendTo(std::vector<uint8_t>& buffer) const;
+
     /**
      * \brief Deserializes a byte vector into a vector of CharacterData objects.
      * \param data A vector of bytes containing serialized character data.
+     * \param mode Wire encoding of data.
      * \return A vector of CharacterData objects populated with the deserialized data.
      */
-    static std::vector<CharacterData> deserializeVector(const std::vector<uint8_t>& data);
+    static std::vector<CharacterData> deserializeVector(const std::vector<uint8_t>& data,
+                                                        Wire::Mode mode = Wire::Mode::Fixed);
+};
+
+/**
+ * \struct CharacterView
+ * \brief Serialized character read in place, without copying its strings
+ *
+ * The string fields point into the buffer the view was parsed from, which
+ * has to outlive the view. Used for requests whose character is only passed
+ * on, so the received frame is not copied into a CharacterData first.
+ */
+struct CharacterView {
+    int32_t id = 0; ///< Unique identifier for the character
+    std::string_view name{}; ///< Character's first name
+    std::string_view surname{}; ///< Character's surname
+    uint8_t age = 1; ///< Character's age
+    std::string_view bio{}; ///< Character's biography
 
     /**
-     * \brief Writes a string to a byte buffer.
-     * \param buffer The buffer to write to.
-     * \param str The string to write.
+     * \brief Parses a serialized character, checking every length against the buffer.
+     * \param data Serialized character, as produced by CharacterData::serialize.
+     * \param size Number of readable bytes at data, trailing bytes are ignored.
+     * \param mode Wire encoding of data.
+     * \return The view, empty optional if the data is truncated.
      */
-    static void write_string(std::vector<uint8_t>& buffer, const std::string& str);
+    static std::optional<CharacterView> parse(const uint8_t* data, size_t size,
+                                              Wire::Mode mode = Wire::Mode::Fixed);
 
     /**
-     * \brief Reads a string from a byte buffer.
-     * \param buffer The buffer to read from.
-     * \param offset The current offset in the buffer, which will be updated.
-     * \return The read string.
+     * \brief Copies the viewed fields into an owning CharacterData.
+     * \return The character.
      */
-    static std::string read_string(const std::vector<uint8_t>& buffer, size_t& offset);
+    CharacterData toData() const;
 };
 
+/// Serialized form of a CharacterData: [id][name][surname][uint8 age][bio]
+using CharacterLayout = Wire::Layout<
+    Wire::Field<&CharacterData::id>,
+    Wire::Field<&CharacterData::name>,
+    Wire::Field<&CharacterData::surname>,
+    Wire::Field<&CharacterData::age>,
+    Wire::Field<&CharacterData::bio>>;
+
+/// Same wire form as CharacterLayout, decoded into views
+using CharacterViewLayout = Wire::Layout<
+    Wire::Field<&CharacterView::id>,
+    Wire::Field<&CharacterView::name>,
+    Wire::Field<&CharacterView::surname>,
+    Wire::Field<&CharacterView::age>,
+    Wire::Field<&CharacterView::bio>>;
+
+static_assert(CharacterLayout::minSize<> == CharacterViewLayout::minSize<> &&
+              CharacterLayout::minSize<Wire::Compact> == CharacterViewLayout::minSize<Wire::Compact>,
+              "CharacterData and CharacterView must share one wire format");
+
 namespace Protocol {
 // Command bytes
 constexpr uint8_t GET_ALL = 0x01; ///< Command to get all characters
@@ -71,15 +164,56 @@ constexpr uint8_t ADD_CHARACTER = 0x02; ///< Command to add a new character
 constexpr uint8_t REMOVE_CHARACTER = 0x03; ///< Command to remove a character
 constexpr uint8_t GET_ONE = 0x04; ///< Command to get a specific character
 constexpr uint8_t UPDATE_CHARACTER = 0x05; ///< Command to update character information
+constexpr uint8_t GET_ALL_STREAM = 0x06; ///< Command to get all characters as a sequence of chunk frames
+constexpr uint8_t ADD_CHARACTERS = 0x07; ///< Command to add a batch of characters, replies with their ids
+constexpr uint8_t GET_RANGE = 0x08; ///< Command to get one page of characters ordered by id
+constexpr uint8_t HELLO = 0x09; ///< Handshake negotiating the session options, see Hello
+constexpr uint8_t MULTI = 0x0A; ///< Envelope running several commands, one combined response
 
 // Response codes
 constexpr uint8_t RESP_SUCCESS = 0x80; ///< Response indicating success
 constexpr uint8_t RESP_ERROR = 0x81; ///< Response indicating an error
+constexpr uint8_t RESP_BUSY = 0x82; ///< Request rejected by admission control, retry later
 
 // Connection limits
 constexpr size_t MAX_CONNECTIONS = 1000; ///< Maximum number of concurrent connections
-// 2x typical core count
-constexpr size_t THREAD_POOL_SIZE = 16; ///< Size of the thread pool for handling requests
+// 2x typical core count, the worker pool itself sizes from the actual core count
+constexpr size_t THREAD_POOL_SIZE = 16; ///< Typical number of workers handling requests
+constexpr size_t IO_THREADS = 1; ///< Default number of threads running the io_context
+// One connection per worker so no worker waits for another's round trip
+constexpr size_t DB_POOL_SIZE = THREAD_POOL_SIZE; ///< Number of pooled MySQL connections
+// Each connection carries one query in flight, no thread waits for it
+constexpr size_t DB_ASYNC_CONNECTIONS = 64; ///< Number of non-blocking MySQL connections
+
+// Character cache in front of the database
+constexpr size_t CACHE_CAPACITY_BYTES = 64 * 1024 * 1024; ///< Memory budget of the character cache
+constexpr size_t CACHE_SHARDS = 16; ///< Number of independently locked cache shards
+
+// In-memory storage engine
+constexpr size_t MEMORY_STORAGE_STRIPES = 64; ///< Number of independently locked stripes
+
+// Pagination
+// GET_RANGE request: [flags][int32 cursor][uint32 limit]
+// GET_RANGE response: [uint8 more][int32 cursor of the next page][serialized characters]
+constexpr uint8_t RANGE_DESCENDING = 0x01; ///< GET_RANGE flag: order by descending id
+constexpr uint8_t RANGE_AFTER_CURSOR = 0x02; ///< GET_RANGE flag: start past the cursor instead of the first id
+constexpr uint32_t RANGE_MAX_LIMIT = 1000; ///< Larger GET_RANGE limits are reduced to this
+
+// Streaming
+// Rows are read in id order and flushed to the socket once a chunk grows past
+// this size. The next chunk is read when the previous one is written, rows
+// changed in between may or may not be part of the stream.
+constexpr size_t STREAM_CHUNK_SIZE = 64 * 1024; ///< Target payload size of one GET_ALL_STREAM frame
+constexpr size_t STREAM_PAGE_ROWS = 256; ///< Characters read from the storage at a time while filling a chunk
+constexpr unsigned STREAM_WRITE_TIMEOUT = 30'000; ///< Milliseconds a chunk may take to drain before the session is closed
+
+// Envelopes
+// MULTI request: [uint32 count] then per command [uint8 command][uint32 length][payload]
+// MULTI response: [uint32 count] then per command [uint32 length][response]
+// Commands run in order with the frame's encoding, each response starts
+// with its own command byte or response code. GET_ALL_STREAM, HELLO and
+// MULTI cannot be nested.
+constexpr uint32_t MAX_MULTI_COMMANDS = 256; ///< Commands one MULTI may carry
 
 // Timeouts (milliseconds)
 // 30000 seconds
@@ -94,6 +228,137 @@ constexpr int PORT = 12345; ///< Server port for communication
 // Message delimiter
 constexpr std::string_view MESSAGE_DELIMITER = "\r\n"; ///< Delimiter for messages
 constexpr uint8_t MESSAGE_DELIMITER_SIZE = 2; ///< Size of the message delimiter
+
+// Framing
+// A connection whose first byte is a frame version uses length-prefixed frames
+// of that version in both directions, see FrameHeader. Any other first byte is
+// a command byte and selects the legacy MESSAGE_DELIMITER terminated messages.
+constexpr uint8_t FRAME_VERSION = 0xF1; ///< Frame version 1, responses in request order
+constexpr uint8_t FRAME_VERSION_PIPELINED = 0xF2; ///< Frame version 2, request ids and out-of-order responses
+constexpr size_t FRAME_HEADER_SIZE = 8; ///< Encoded size of a version 1 FrameHeader
+constexpr size_t FRAME_HEADER_SIZE_PIPELINED = 12; ///< Encoded size of a version 2 FrameHeader
+constexpr uint32_t MAX_FRAME_SIZE = 64 * 1024 * 1024; ///< Largest accepted request payload
+// Reading pauses while this many requests of a pipelined connection are unanswered
+constexpr size_t MAX_PIPELINE_DEPTH = 64; ///< Requests a pipelined connection may have in flight
+
+// Admission control
+// Requests handed to the workers or the async database count until their
+// final response, requests past the limit are answered with RESP_BUSY
+constexpr size_t MAX_QUEUED_REQUESTS = 4096; ///< Requests queued or running server-wide
+// Queued responses are written together in one gather write, within these bounds
+constexpr size_t MAX_WRITE_BATCH_FRAMES = 64; ///< Most frames in one socket write
+constexpr size_t MAX_WRITE_BATCH_BYTES = 256 * 1024; ///< Frames are added to a write until it reaches this size
+
+// Frame flags
+// A request with FRAME_FLAG_COMPACT carries and asks for characters, and
+// vectors of them, in the Wire::Compact encoding. Other fields such as the
+// GET_RANGE cursor or the ADD_CHARACTERS ids stay fixed, and so do
+// GET_ALL_STREAM chunks. The response frame echoes the flag, servers without
+// compact support answer without it.
+constexpr uint16_t FRAME_FLAG_COMPACT = 0x0001; ///< Characters use the compact encoding
+// A GET_ALL request with FRAME_FLAG_PACKED accepts a packed response: the
+// characters sorted by id, every id but the first stored as the difference
+// to the previous one. The response echoes the flag. Packed payloads of at
+// least PACK_COMPRESS_THRESHOLD bytes are also deflated, marked by
+// FRAME_FLAG_DEFLATE, and sent as [uint32 inflated size][zlib stream].
+constexpr uint16_t FRAME_FLAG_PACKED = 0x0002; ///< GET_ALL: sorted, delta encoded ids
+constexpr uint16_t FRAME_FLAG_DEFLATE = 0x0004; ///< Response payload is zlib compressed
+constexpr size_t PACK_COMPRESS_THRESHOLD = 4 * 1024; ///< Smaller packed payloads are sent uncompressed
+
+// Handshake
+// Optional HELLO as the first frame of a length-prefixed connection. Without
+// it a session keeps the defaults: per-request flags, MAX_PIPELINE_DEPTH and
+// no limit on response frames.
+constexpr uint16_t PROTOCOL_VERSION = 1; ///< Highest protocol version of this server
+constexpr uint32_t CAP_COMPACT = 0x01; ///< Every request uses FRAME_FLAG_COMPACT
+constexpr uint32_t CAP_PACKED = 0x02; ///< Every GET_ALL uses FRAME_FLAG_PACKED
+constexpr uint32_t CAP_DEFLATE = 0x04; ///< Packed responses may be deflated, always allowed without a HELLO
+constexpr uint32_t CAP_PIPELINED = 0x08; ///< Out-of-order responses, granted on version 2 frames only
 }
 
+/**
+ * \struct FrameHeader
+ * \brief Header in front of every length-prefixed frame
+ *
+ * Encoded little endian, followed by exactly length payload bytes:
+ * - version 1: [uint8 version][uint8 command][uint16 flags][uint32 length]
+ * - version 2: [uint8 version][uint8 command][uint16 flags][uint32 request id][uint32 length]
+ *
+ * Responses carry the response code or command byte in the command field.
+ * On version 2 connections every response frame echoes the request id of
+ * its request, so responses may arrive in any order.
+ */
+struct FrameHeader {
+    uint8_t version = Protocol::FRAME_VERSION; ///< Frame format version
+    uint8_t command = 0; ///< Command byte or response code
+    uint16_t flags = 0; ///< Protocol::FRAME_FLAG_* bits, unknown bits are ignored
+    uint32_t requestId = 0; ///< Correlation id chosen by the client, version 2 only
+    uint32_t length = 0; ///< Payload size in bytes
+
+    /**
+     * \brief Gets the encoded header size of a frame version.
+     * \param version Frame version byte.
+     * \return Header size in bytes, 0 for an unknown version.
+     */
+    static size_t encodedSize(uint8_t version);
+
+    /**
+     * \brief Encodes the header.
+     * \param buffer Receives encodedSize(version) bytes.
+     * \return Number of bytes written.
+     */
+    size_t encode(uint8_t* buffer) const;
+
+    /**
+     * \brief Decodes a header.
+     * \param buffer encodedSize(buffer[0]) encoded bytes, the version must be known.
+     * \return The decoded header.
+     */
+    static FrameHeader decode(const uint8_t* buffer);
+};
+
+/**
+ * \struct Hello
+ * \brief Payload of a HELLO request
+ *
+ * The client offers what it supports, the server answers with a HelloReply
+ * holding what the session will use. Fields appended by newer clients are
+ * ignored.
+ */
+struct Hello {
+    uint16_t version = Protocol::PROTOCOL_VERSION; ///< Highest protocol version of the client
+    uint32_t capabilities = 0; ///< Protocol::CAP_* bits the client wants
+    uint32_t maxFrameSize = 0; ///< Largest response payload the client accepts, 0 for no limit
+    uint16_t pipelineDepth = 0; ///< Requests the client wants in flight, 0 for the server maximum
+};
+
+/// Serialized form of a Hello
+using HelloLayout = Wire::Layout<
+    Wire::Field<&Hello::version>,
+    Wire::Field<&Hello::capabilities>,
+    Wire::Field<&Hello::maxFrameSize>,
+    Wire::Field<&Hello::pipelineDepth>>;
+
+/**
+ * \struct HelloReply
+ * \brief Payload of the response to a HELLO
+ */
+struct HelloReply {
+    uint16_t version = Protocol::PROTOCOL_VERSION; ///< Protocol version of the session
+    uint32_t capabilities = 0; ///< Protocol::CAP_* bits granted
+    uint32_t maxFrameSize = Protocol::MAX_FRAME_SIZE; ///< Largest request payload the server accepts
+    uint16_t pipelineDepth = 0; ///< Requests the session may have in flight
+    uint32_t rangeMaxLimit = Protocol::RANGE_MAX_LIMIT; ///< Largest GET_RANGE page
+    uint32_t streamChunkSize = Protocol::STREAM_CHUNK_SIZE; ///< Target payload size of GET_ALL_STREAM chunks
+};
+
+/// Serialized form of a HelloReply
+using HelloReplyLayout = Wire::Layout<
+    Wire::Field<&HelloReply::version>,
+    Wire::Field<&HelloReply::capabilities>,
+    Wire::Field<&HelloReply::maxFrameSize>,
+    Wire::Field<&HelloReply::pipelineDepth>,
+    Wire::Field<&HelloReply::rangeMaxLimit>,
+    Wire::Field<&HelloReply::streamChunkSize>>;
+
 #endif // PROTOCOL_H
@@ -0,0 +1,86 @@
+/**
+ * \file server_config.h
+ * \brief Startup options of the server
+ */
+
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+
+#include <string>
+
+#include "protocol.h"
+
+/**
+ * \struct ServerConfig
+ * \brief Options chosen at startup, filled from the command line
+ *
+ * Every option has a default, so running the server without arguments keeps
+ * the original behaviour: MySQL storage on localhost and Protocol::PORT.
+ */
+struct ServerConfig {
+    /**
+     * \enum Backend
+     * \brief Storage engine serving the character data
+     */
+    enum class Backend {
+        MySql, ///< DatabaseManager on a MySQL server
+        Memory, ///< MemoryStorage, nothing is persisted
+        Log ///< LogStorage in the data directory, UNIX only
+    };
+
+    /**
+     * \enum DbMode
+     * \brief How MySQL queries are executed
+     */
+    enum class DbMode {
+        Blocking, ///< On thread pool workers with pooled connections
+        Async ///< AsyncDatabase on the io_context, needs MariaDB Connector/C
+    };
+
+    /**
+     * \enum IoMode
+     * \brief How the I/O threads share the connections
+     */
+    enum class IoMode {
+        Shared, ///< All threads run one io_context with one acceptor
+        Sharded ///< Each thread owns an io_context, a SO_REUSEPORT acceptor and its sessions
+    };
+
+    Backend backend = Backend::MySql; ///< Selected storage engine
+    unsigned short port = Protocol::PORT; ///< Port the server listens on
+    size_t ioThreads = Protocol::IO_THREADS; ///< Threads running the io_context, the shard count in sharded mode
+    IoMode ioMode = IoMode::Shared; ///< Distribution of the connections over the I/O threads
+    bool pinCpus = false; ///< Pin I/O thread i to CPU i, Linux only
+    size_t maxQueued = Protocol::MAX_QUEUED_REQUESTS; ///< Requests waiting for a worker or the database, server-wide
+    size_t sessionQueue = Protocol::MAX_PIPELINE_DEPTH; ///< Requests in flight per connection before its reads pause
+
+    std::string dbHost = "localhost"; ///< MySQL server hostname or IP address
+    std::string dbUser = "character_user"; ///< MySQL username
+    std::string dbPass = "secure_password_123"; ///< MySQL password
+    std::string dbName = "character_db"; ///< MySQL database name
+    size_t dbPoolSize = Protocol::DB_POOL_SIZE; ///< Number of pooled MySQL connections
+    DbMode dbMode = DbMode::Blocking; ///< Execution of single-row and GET_ALL queries
+    size_t dbAsyncConnections = Protocol::DB_ASYNC_CONNECTIONS; ///< Connections of the async mode
+
+    std::string dataDir = "data"; ///< Directory of the embedded log storage
+    std::string snapshotPath; ///< Snapshot written at shutdown and served at startup, empty to disable
+
+    /**
+     * \brief Builds the configuration from command line arguments
+     * \param argc Argument count as passed to main
+     * \param argv Argument values as passed to main
+     * \return Parsed configuration
+     * \throws std::invalid_argument on an unknown option or invalid value
+     *
+     * Options have the form --name=value, see usage().
+     */
+    static ServerConfig fromCommandLine(int argc, char* argv[]);
+
+    /**
+     * \brief Gets the help text listing all options
+     * \return Usage text
+     */
+    static std::string usage();
+};
+
+#endif // SERVERCONFIG_H
@@ -8,9 +8,14 @@
 
 #include <boost/asio.hpp>
 #include <memory>
+#include <vector>
 #include "protocol.h"
+#include "server_config.h"
 
+class AsyncDatabase;
 class SessionManager;
+class StorageBackend;
+class WarmStartStorage;
 
 /**
  * \class ServerInstance
@@ -28,19 +33,25 @@ public:
     static ServerInstance& getInstance();
 
     /**
-     * \brief Initializes the server on the specified port.
-     * \param port The port number on which the server will listen for incoming connections.
+     * \brief Initializes the storage backend and starts listening.
+     * \param config Startup options, including the port and the storage backend.
      * \return True if initialization was successful, false otherwise.
      */
-    bool initialize(unsigned short port);
+    bool initialize(const ServerConfig& config);
 
     /**
      * \brief Runs the server, starting the asynchronous operations.
+     *
+     * Runs ServerConfig::ioThreads threads, the calling thread being one of
+     * them. In the shared mode they all run one io_context, in the sharded
+     * mode each runs the io_context of its shard. SIGINT and SIGTERM stop the
+     * server. Returns once the server is stopped and its sessions are closed.
      */
     void run();
 
     /**
-     * \brief Stops the server and cleans up resources.
+     * \brief Stops the I/O threads, run() then shuts the server down.
+     * \note Safe to call from any thread.
      */
     void stop();
 
@@ -57,6 +68,19 @@ private:
     /// Private destructor.
     ~ServerInstance();
 
+    /**
+     * \struct Shard
+     * \brief Everything one I/O thread serves in the sharded mode
+     *
+     * Sessions never leave the shard that accepted them, shards only share
+     * the storage backend.
+     */
+    struct Shard {
+        boost::asio::io_context ioContext{1}; ///< Run by the shard's thread only.
+        std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor; ///< SO_REUSEPORT acceptor on the server port.
+        std::shared_ptr<SessionManager> sessionManager; ///< Sessions of this shard.
+    };
+
     // Deleted copy constructor and assignment operator to enforce singleton.
     ServerInstance(const ServerInstance&) = delete;
     ServerInstance& operator=(const ServerInstance&) = delete;
@@ -72,9 +96,50 @@ private:
      */
     void cleanupSingleInstanceLock();
 
+    /**
+     * \brief Sets up the storage serving the sessions.
+     * \return True if reads can be served, false otherwise.
+     *
+     * With a snapshot present the backend is opened in the background while
+     * the snapshot serves reads, otherwise it is opened right away.
+     */
+    bool initializeStorage();
+
+    /**
+     * \brief Creates and connects the storage backend selected in the config.
+     * \return The backend if it is ready, nullptr otherwise.
+     */
+    StorageBackend* openStorage();
+
+    /**
+     * \brief Writes the snapshot for the next start, if one is configured.
+     */
+    void saveSnapshot();
+
+    /**
+     * \brief Creates one shard per I/O thread, each listening on the server port.
+     * \return True if every shard is listening, false otherwise.
+     */
+    bool initializeShards();
+
+    /**
+     * \brief Closes the acceptors and sessions and prints the counters.
+     * \note Called by run() once no I/O thread is left.
+     */
+    void shutdown();
+
+    ServerConfig m_config; ///< Startup options.
+    std::unique_ptr<StorageBackend> m_ownedStorage; ///< Storage backends other than the DatabaseManager singleton.
+    std::unique_ptr<WarmStartStorage> m_warmStart; ///< Snapshot in front of the backend during a warm start.
+    StorageBackend* m_storage = nullptr; ///< Storage backend serving all sessions.
     boost::asio::io_context m_ioContext; ///< IO context for asynchronous operations.
+#ifdef HAVE_MYSQL_NONBLOCKING
+    std::unique_ptr<AsyncDatabase> m_asyncDatabase; ///< Non-blocking MySQL executor in the async db mode.
+#endif
     std::unique_ptr<boost::asio::ip::tcp::acceptor> m_acceptor; ///< Accepts incoming connections.
     std::shared_ptr<SessionManager> m_sessionManager; ///< Manages active sessions.
+    std::vector<std::unique_ptr<Shard>> m_shards; ///< I/O shards in the sharded mode, empty otherwise.
+    std::unique_ptr<boost::asio::signal_set> m_signals; ///< SIGINT and SIGTERM, handled on the first I/O thread's context.
 
     // For enforcing a single instance across platforms
 #ifdef _WIN32
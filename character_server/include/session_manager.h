@@ -2,12 +2,29 @@
 #define SESSIONMANAGER_H
 
 #include <boost/asio.hpp>
-#include <boost/asio/thread_pool.hpp>
+#include <array>
 #include <atomic>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <mutex>
-#include "database_manager.h"
+#include <unordered_map>
 #include "protocol.h"
+#include "storage_backend.h"
+#include "work_stealing_pool.h"
+
+class AsyncDatabase;
+
+/**
+ * \struct SessionLimits
+ * \brief Resource limits of a SessionManager
+ */
+struct SessionLimits {
+    size_t workerThreads = 0; ///< Size of the thread pool, 0 for WorkStealingPool::defaultSize()
+    size_t maxConnections = Protocol::MAX_CONNECTIONS; ///< Sessions served at the same time
+    size_t maxQueued = Protocol::MAX_QUEUED_REQUESTS; ///< Requests queued or running for all sessions
+    size_t sessionQueue = Protocol::MAX_PIPELINE_DEPTH; ///< Requests one pipelined session may have in flight
+};
 
 /**
  * \class SessionManager
@@ -22,8 +39,13 @@ public:
     /**
      * \brief Constructs a SessionManager with the given IO context.
      * \param ioContext The IO context used for asynchronous operations.
+     * \param storage The storage backend serving all character operations.
+     * \param asyncDatabase Runs the commands it supports without the thread pool, may be nullptr.
+     * \param limits Worker, connection and queue limits.
      */
-    explicit SessionManager(boost::asio::io_context& ioContext);
+    SessionManager(boost::asio::io_context& ioContext, StorageBackend& storage,
+                   AsyncDatabase* asyncDatabase = nullptr,
+                   const SessionLimits& limits = SessionLimits());
 
     /// Destructor for SessionManager.
     ~SessionManager();
@@ -35,10 +57,23 @@ public:
     void startAccept(boost::asio::ip::tcp::acceptor& acceptor);
 
     /**
-     * \brief Stops the SessionManager and cleans up resources.
+     * \brief Stops accepting, closes the open sessions and joins the worker pool.
+     * \note Called once no thread runs the io_context anymore.
      */
     void stop();
 
+    /**
+     * \brief Gets the counters of the worker pool
+     * \return Counter snapshot, including the current queue depths
+     */
+    WorkStealingPool::Stats workerStats() const { return m_threadPool.stats(); }
+
+    /**
+     * \brief Gets the number of requests answered with RESP_BUSY
+     * \return Rejected requests since the start
+     */
+    uint64_t rejectedRequests() const { return m_rejected; }
+
 private:
     /**
      * \class Session
@@ -67,7 +102,72 @@ private:
          */
         boost::asio::ip::tcp::socket& socket() { return m_socket; }
 
+        /**
+         * \brief Closes the session and completes the frames still queued.
+         * \note Called on m_strand, or by SessionManager::stop() once no
+         *       thread runs the io_context.
+         */
+        void close();
+
     private:
+        /**
+         * \enum Framing
+         * \brief How messages are delimited on this connection
+         */
+        enum class Framing {
+            Unknown, ///< Nothing received yet, decided by the first byte
+            Legacy, ///< Command byte, payload and MESSAGE_DELIMITER
+            Length ///< FrameHeader followed by an exact-length payload
+        };
+
+        /**
+         * \struct Request
+         * \brief Identifies the request a response belongs to
+         */
+        struct Request {
+            uint8_t command = 0; ///< Command byte of the request
+            uint32_t id = 0; ///< Request id of a pipelined frame, echoed in its responses
+            uint16_t flags = 0; ///< Frame flags of the request, Protocol::FRAME_FLAG_*
+            bool admitted = false; ///< Counted by admission control until its final response
+
+            /// Wire encoding of the characters in the request and its response.
+            Wire::Mode mode() const {
+                return (flags & Protocol::FRAME_FLAG_COMPACT) ? Wire::Mode::Compact : Wire::Mode::Fixed;
+            }
+        };
+
+        /**
+         * \struct Options
+         * \brief Session options, changed by a HELLO
+         */
+        struct Options {
+            uint16_t defaultFlags = 0; ///< Frame flags added to every request
+            bool deflate = true; ///< Packed responses may be deflated
+            size_t pipelineDepth = Protocol::MAX_PIPELINE_DEPTH; ///< Requests a pipelined session may have in flight
+            uint32_t maxResponseSize = 0; ///< Largest response payload the client accepts, 0 for no limit
+            size_t streamChunkSize = Protocol::STREAM_CHUNK_SIZE; ///< Largest GET_ALL_STREAM chunk, within maxResponseSize
+        };
+
+        /**
+         * \struct Outgoing
+         * \brief One response frame kept alive until its write completes
+         */
+        struct Outgoing {
+            std::array<uint8_t, Protocol::FRAME_HEADER_SIZE_PIPELINED> header{}; ///< Frame header, or the command byte in legacy mode
+            size_t headerSize = 0; ///< Used bytes of header
+            std::vector<uint8_t> data; ///< Buffer holding the payload
+            size_t payloadOffset = 0; ///< Start of the payload in data
+            bool delimited = false; ///< Legacy mode, MESSAGE_DELIMITER follows the payload
+            bool final = true; ///< Last frame of its request's response
+            std::function<void(const boost::system::error_code&)> onWritten; ///< Called once the write finished, may be empty
+
+            /**
+             * \brief Gets the buffer sequence to write.
+             * \return Header, payload and delimiter buffers, unused ones are empty.
+             */
+            std::array<boost::asio::const_buffer, 3> buffers() const;
+        };
+
         /**
          * \brief Reads the header of a message from the client.
          */
@@ -78,24 +178,133 @@ private:
          */
         void readBody();
 
+        /**
+         * \brief Reads a length-prefixed frame.
+         * \param received Header bytes already in m_frameHeader.
+         */
+        void readFrame(size_t received);
+
+        /**
+         * \brief Hands a complete request to the async database or the thread pool.
+         * \param request The request.
+         * \param message The request payload.
+         */
+        void dispatch(const Request& request, std::vector<uint8_t>&& message);
+
+        /**
+         * \brief Wraps response data for the framing of this connection.
+         * \param request Request the response belongs to.
+         * \param command Command byte or response code of the response.
+         * \param data Buffer holding the payload.
+         * \param payloadOffset Start of the payload in data.
+         * \param flags Frame flags describing the response payload.
+         * \return Response ready to be queued.
+         */
+        std::shared_ptr<Outgoing> makeOutgoing(const Request& request, uint8_t command,
+                                               std::vector<uint8_t>&& data, size_t payloadOffset,
+                                               uint16_t flags = 0) const;
+
+        /**
+         * \brief Queues a response frame for writing.
+         * \param outgoing Frame to write.
+         * \note May be called from any thread.
+         */
+        void enqueue(std::shared_ptr<Outgoing> outgoing);
+
+        /**
+         * \brief Starts writing the queued frames, if no write is in flight.
+         * \note Frames queued by then are coalesced into one gather write.
+         */
+        void writeNext();
+
+        /**
+         * \brief Completes the frames of the finished write.
+         * \param ec Result of the write.
+         */
+        void handleWrite(const boost::system::error_code& ec);
+
+        /**
+         * \brief Negotiates the session options.
+         * \param request The HELLO request.
+         * \param message Hello payload.
+         * \note Runs on m_strand before the next request is read, so
+         *       every later request sees the new options.
+         */
+        void hello(const Request& request, const std::vector<uint8_t>& message);
+
         /**
          * \brief Processes a received binary message.
+         * \param request The request, its command selects the operation.
          * \param message The binary message data (moved into the function).
          * \note This function uses move semantics to efficiently handle
          *       message processing in a thread pool with lambdas.
          */
-        void processMessage(std::vector<uint8_t> &&message);
+        void processMessage(const Request& request, std::vector<uint8_t> &&message);
+
+        /**
+         * \brief Runs a single-response command.
+         * \param request The request, its command selects the operation.
+         * \param message The binary message data.
+         * \param flags Receives the frame flags describing the response payload.
+         * \return The response, starting with its command byte or response code.
+         * \throws std::runtime_error if the request is invalid or the operation failed.
+         */
+        std::vector<uint8_t> execute(const Request& request, const std::vector<uint8_t>& message,
+                                     uint16_t& flags);
+
+        /**
+         * \brief Runs the commands of a MULTI envelope.
+         * \param request The MULTI request.
+         * \param message The envelope, see Protocol::MULTI.
+         * \return The combined response.
+         * \throws std::runtime_error if the envelope is malformed.
+         * \note Runs of GET_ONE are looked up with one StorageBackend::getCharacters()
+         *       call, a failing command only fails its own entry.
+         */
+        std::vector<uint8_t> processMulti(const Request& request, const std::vector<uint8_t>& message);
 
         /**
-         * \brief Sends a response back to the client.
+         * \brief Answers a request on m_strand if the storage can do it without blocking.
+         * \param request The request, its command selects the operation.
+         * \param message The binary message data, moved from if the request was answered.
+         * \return true if the request was answered, false if it has to go elsewhere.
+         * \note Covers GET_ONE on StorageBackend::tryGetCharacter() hits and single
+         *       writes on backends with StorageBackend::hasNonBlockingWrites().
+         */
+        bool processInline(const Request& request, std::vector<uint8_t>& message);
+
+        /**
+         * \brief Starts a command on the async database if it supports it.
+         * \param request The request, its command selects the operation.
+         * \param message The binary message data.
+         * \return true if the command was started, false if it has to go to the thread pool.
+         * \note Called on m_strand, the response is sent from the
+         *       database completion handler.
+         */
+        bool processAsync(const Request& request, const std::vector<uint8_t>& message);
+
+        /**
+         * \brief Sends the response that completes a request.
+         * \param request The request being answered.
          * \param data The response data to send (moved into the function).
+         * \param flags Frame flags describing the response payload.
          */
-        void sendResponse(std::vector<uint8_t> &&data);
+        void sendResponse(const Request& request, std::vector<uint8_t> &&data, uint16_t flags = 0);
 
         /**
-         * \brief Closes the session and cleans up resources.
+         * \brief Answers a request with RESP_ERROR and closes the session once it is written.
+         * \param request The failed request.
          */
-        void close();
+        void fail(const Request& request);
+
+        /**
+         * \brief Sends the next chunk of a GET_ALL_STREAM response.
+         * \param request The stream request, in the fixed encoding.
+         * \param afterId Last id sent so far, empty before the first chunk.
+         * \note Runs on a thread pool worker. The next chunk is read once this
+         *       one is written, so a slow reader holds one chunk and no worker.
+         */
+        void streamNext(const Request& request, std::optional<int32_t> afterId);
 
         /**
          * \brief Handles session timeout.
@@ -103,12 +312,29 @@ private:
          */
         void handleTimeout(const boost::system::error_code& ec);
 
-        boost::asio::ip::tcp::socket m_socket; ///< Socket for client communication.
-        boost::asio::steady_timer m_timeoutTimer; ///< Timer for session timeouts.
+        /// Serializes every handler of the session, the I/O threads run sessions in parallel.
+        boost::asio::strand<boost::asio::io_context::executor_type> m_strand;
+        boost::asio::ip::tcp::socket m_socket; ///< Socket for client communication, its handlers run on m_strand.
+        boost::asio::steady_timer m_timeoutTimer; ///< Timer for read timeouts.
+        boost::asio::steady_timer m_writeTimer; ///< Timer for write timeouts.
         SessionManager& m_manager; ///< Reference to the managing SessionManager.
         std::vector<uint8_t> m_readBuffer; ///< Buffer for reading incoming messages.
         std::vector<uint8_t> m_writeBuffer; ///< Buffer for outgoing messages.
-        uint8_t m_currentCommand = 0; ///< Current command being processed.
+        uint8_t m_currentCommand = 0; ///< Command byte of the legacy message being read.
+        Framing m_framing = Framing::Unknown; ///< Message framing of this connection.
+        uint8_t m_frameVersion = 0; ///< Frame version of a Length framed connection.
+        Options m_options; ///< Negotiated options, written on m_strand before requests use them.
+        bool m_receivedRequest = false; ///< A request was dispatched, HELLO is no longer accepted.
+        std::array<uint8_t, Protocol::FRAME_HEADER_SIZE_PIPELINED> m_frameHeader{}; ///< Header of the frame being read.
+
+        // Touched on m_strand only
+        std::deque<std::shared_ptr<Outgoing>> m_writeQueue; ///< Frames waiting to be written.
+        bool m_writing = false; ///< A write is in flight.
+        std::vector<std::shared_ptr<Outgoing>> m_writeBatch; ///< Frames of the write in flight.
+        std::vector<boost::asio::const_buffer> m_writeBuffers; ///< Buffer sequence of the write in flight.
+        size_t m_inFlight = 0; ///< Pipelined requests without a final response yet.
+        bool m_readPaused = false; ///< Reading stopped at the pipeline depth.
+        std::atomic<bool> m_closed{false}; ///< Set by the first close().
     };
 
     /**
@@ -123,11 +349,28 @@ private:
             const boost::system::error_code& error
             );
 
+    /**
+     * \brief Counts a request that is handed to the workers or the async database.
+     * \return false if SessionLimits::maxQueued requests are already queued or running.
+     */
+    bool admit();
+
+    /**
+     * \brief Stops counting an admitted request, called with its final response.
+     */
+    void release();
+
     boost::asio::io_context& m_ioContext; ///< IO context for asynchronous operations.
-    boost::asio::thread_pool m_threadPool; ///< Thread pool for processing messages.
+    StorageBackend& m_storage; ///< Storage backend serving all character operations.
+    AsyncDatabase* m_asyncDatabase; ///< Non-blocking MySQL executor, nullptr in blocking mode.
+    WorkStealingPool m_threadPool; ///< Thread pool for processing messages.
     std::atomic<size_t> m_activeConnections{0}; ///< Count of active connections.
+    SessionLimits m_limits; ///< Worker, connection and queue limits.
+    std::atomic<size_t> m_queued{0}; ///< Admitted requests without a final response yet.
+    std::atomic<uint64_t> m_rejected{0}; ///< Requests answered with RESP_BUSY.
     std::mutex m_mutex; ///< Mutex for synchronizing access to shared resources.
     bool m_stopping = false; ///< Flag indicating if the manager is stopping.
+    std::unordered_map<Session*, std::weak_ptr<Session>> m_sessions; ///< Open sessions, guarded by m_mutex.
 };
 
 #endif // SESSIONMANAGER_H
@@ -0,0 +1,128 @@
+/**
+ * \file snapshot.h
+ * \brief Memory-mapped snapshot file of the character set
+ *
+ * This file contains the declaration of the Snapshot class which writes the
+ * whole character set to a compact binary file and serves reads straight
+ * from a read-only mapping of it.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "storage_backend.h"
+
+/**
+ * \class Snapshot
+ * \brief Read-only, id-indexed character snapshot backed by mmap
+ *
+ * File layout, all integers little endian:
+ * - header: magic, version, character count (uint32 each), index offset (uint64)
+ * - records: CharacterData::serialize bytes, back to back
+ * - index: one {id, size, offset} entry per character, sorted by id
+ *
+ * Opening maps the file and checks the index once, lookups are a binary
+ * search over the mapped index, so no data is read before it is used.
+ *
+ * \note Uses POSIX mmap and is only built on UNIX platforms.
+ */
+class Snapshot {
+public:
+    /**
+     * \brief Writes a snapshot of all characters of a backend
+     * \param path File to write, replaced atomically
+     * \param source Backend whose characters are dumped
+     * \return true if the snapshot was written and synced, false otherwise
+     */
+    static bool write(const std::string& path, StorageBackend& source);
+
+    /**
+     * \brief Maps an existing snapshot file
+     * \param path Snapshot file
+     * \return Mapped snapshot, nullptr if the file is missing or invalid
+     */
+    static std::unique_ptr<Snapshot> open(const std::string& path);
+
+    /**
+     * \brief Destructor that unmaps the file
+     */
+    ~Snapshot();
+
+    // Prevent copying and assignment
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    /**
+     * \brief Gets the number of characters in the snapshot
+     * \return Character count
+     */
+    size_t size() const { return m_count; }
+
+    /**
+     * \brief Looks up a character by id
+     * \param id ID of the character
+     * \return Character, empty optional if the id is not in the snapshot
+     */
+    std::optional<CharacterData> getCharacter(int32_t id) const;
+
+    /**
+     * \brief Gets all characters ordered by id
+     * \return All characters of the snapshot
+     */
+    std::vector<CharacterData> getAllCharacters() const;
+
+    /**
+     * \brief Gets one page of characters ordered by id, see StorageBackend
+     * \param afterId Only ids past this one in the requested order are returned,
+     *        empty optional to start at the first id
+     * \param limit Maximum number of characters
+     * \param descending Order by descending instead of ascending id
+     * \return Up to limit characters in the requested order
+     */
+    std::vector<CharacterData> getCharacterRange(std::optional<int32_t> afterId,
+                                                 size_t limit, bool descending) const;
+
+    /**
+     * \brief Streams all characters in serialized chunks, see StorageBackend
+     * \param chunkSize Payload size after which a chunk is handed to the sink
+     * \param sink Callback receiving every non-empty chunk in order
+     * \return true if every character was streamed, false if the sink stopped
+     */
+    bool streamAllCharacters(size_t chunkSize, const StorageBackend::ChunkSink& sink) const;
+
+private:
+    /**
+     * \struct IndexEntry
+     * \brief Position of one record, as stored in the file
+     */
+    struct IndexEntry {
+        int32_t id; ///< Character id
+        uint32_t size; ///< Serialized record size
+        uint64_t offset; ///< Offset of the record in the file
+    };
+
+    /**
+     * \brief Wraps a mapping whose header and index were validated
+     */
+    Snapshot(void* mapping, size_t length, const IndexEntry* index, uint32_t count);
+
+    /**
+     * \brief Decodes the record of an index entry straight from the mapping
+     * \param entry Index entry
+     * \return Stored character, empty optional if the record does not parse
+     */
+    std::optional<CharacterData> read(const IndexEntry& entry) const;
+
+    void* m_mapping = nullptr; ///< Start of the mapping
+    size_t m_length = 0; ///< Length of the mapping
+    const IndexEntry* m_index = nullptr; ///< Mapped index, sorted by id
+    uint32_t m_count = 0; ///< Number of index entries
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,169 @@
+/**
+ * \file statement_cache.h
+ * \brief Prepared statements kept alive for the lifetime of one MySQL connection
+ *
+ * This file contains the declaration of the StatementCache class. Each pooled
+ * connection owns one cache, so every statement is prepared once per
+ * connection instead of once per request, and its bind layout is allocated once.
+ */
+
+#ifndef STATEMENTCACHE_H
+#define STATEMENTCACHE_H
+
+#include <mysql/mysql.h>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "protocol.h"
+
+/**
+ * \class StatementCache
+ * \brief Lazily prepared statements and preallocated bind layouts of a connection
+ *
+ * Statements are prepared on first use. Parameter bind arrays have their
+ * buffer types filled in once, so callers only point them at the request
+ * data. Statements returning characters share one bound result row.
+ * The cache is destroyed together with its connection, so statements are
+ * re-prepared transparently after a reconnect.
+ */
+class StatementCache {
+public:
+    /**
+     * \enum Id
+     * \brief Statements known to the cache
+     */
+    enum Id : size_t {
+        INSERT_CHARACTER = 0, ///< INSERT of a single character
+        UPDATE_CHARACTER, ///< UPDATE of a character by id
+        DELETE_CHARACTER, ///< DELETE of a character by id
+        SELECT_CHARACTER, ///< SELECT of a character by id
+        SELECT_RANGE_ASC, ///< SELECT of a page of characters after an id, ascending
+        SELECT_RANGE_DESC, ///< SELECT of a page of characters before an id, descending
+        STATEMENT_COUNT ///< Number of statements, not a statement
+    };
+
+    /// Maximum number of parameters of any cached statement.
+    static constexpr size_t MAX_PARAMS = 5;
+
+    /// Rows inserted by one full multi-row INSERT of a batch.
+    static constexpr size_t BATCH_INSERT_ROWS = 500;
+
+    /// Parameters per row of a multi-row INSERT: name, surname, age, bio.
+    static constexpr size_t BATCH_INSERT_PARAMS = 4;
+
+    /**
+     * \brief Creates an empty cache for a connection
+     * \param connection MySQL connection the statements are prepared on
+     */
+    explicit StatementCache(MYSQL* connection);
+
+    /**
+     * \brief Destructor that closes all prepared statements
+     */
+    ~StatementCache();
+
+    // Prevent copying and assignment
+    StatementCache(const StatementCache&) = delete;
+    StatementCache& operator=(const StatementCache&) = delete;
+
+    /**
+     * \brief Gets a prepared statement, preparing it on first use
+     * \param id Statement to get
+     * \return Prepared statement, nullptr if preparing failed
+     */
+    MYSQL_STMT* get(Id id);
+
+    /**
+     * \brief Gets the preallocated parameter bind layout of a statement
+     * \param id Statement whose parameters are requested
+     * \return Array of MAX_PARAMS binds with their buffer types already set
+     */
+    MYSQL_BIND* params(Id id) { return m_params[id].data(); }
+
+    /**
+     * \brief Gets a multi-row INSERT statement, preparing it on first use
+     * \param rows Number of rows the statement inserts, at most BATCH_INSERT_ROWS
+     * \return Prepared statement, nullptr if preparing failed
+     * \note The full size statement and the most recent shorter one are kept.
+     */
+    MYSQL_STMT* getBatchInsert(size_t rows);
+
+    /**
+     * \brief Gets the preallocated parameter layout of multi-row INSERTs
+     * \return Array of BATCH_INSERT_ROWS * BATCH_INSERT_PARAMS binds
+     */
+    MYSQL_BIND* batchParams() { return m_batchParams.data(); }
+
+    /**
+     * \brief Fetches the next row of a character returning statement
+     * \param stmt Executed statement obtained from get()
+     * \param character Receives the fetched character
+     * \return true if a row was fetched, false at the end of the result or on error
+     */
+    bool fetchCharacter(MYSQL_STMT* stmt, CharacterData& character);
+
+    /**
+     * \brief Points a string parameter at a value
+     * \param bind Parameter bind to update
+     * \param value String the parameter reads from
+     */
+    static void bindString(MYSQL_BIND& bind, std::string_view value);
+
+    /**
+     * \brief Points a numeric parameter at a value
+     * \param bind Parameter bind to update
+     * \param value Value the parameter reads from
+     */
+    template<typename T>
+    static void bindValue(MYSQL_BIND& bind, const T& value) {
+        bind.buffer = const_cast<T*>(&value);
+    }
+
+private:
+    /**
+     * \struct CharacterRow
+     * \brief Result buffers bound to every character returning statement
+     */
+    struct CharacterRow {
+        int32_t id = 0; ///< id column
+        char name[51] = {0}; ///< name column
+        char surname[51] = {0}; ///< surname column
+        int32_t age = 0; ///< age column
+        char bio[4096] = {0}; ///< bio column, longer values are fetched separately
+        unsigned long length[5] = {0}; ///< Actual column lengths
+        my_bool isNull[5] = {0}; ///< Column null flags
+        my_bool error[5] = {0}; ///< Column truncation flags
+        MYSQL_BIND bind[5]{}; ///< Result binds pointing at the buffers above
+    };
+
+    /**
+     * \struct BatchInsert
+     * \brief Multi-row INSERT statement and the number of rows it was prepared for
+     */
+    struct BatchInsert {
+        MYSQL_STMT* stmt = nullptr; ///< Prepared statement, nullptr until used
+        size_t rows = 0; ///< Rows per execution
+    };
+
+    /**
+     * \brief Reads a string column, fetching it again if it was truncated
+     * \param stmt Statement the row was fetched from
+     * \param column Column index
+     * \param buffer Bound buffer of the column
+     * \return Full column value
+     */
+    std::string readString(MYSQL_STMT* stmt, unsigned int column, const char* buffer);
+
+    MYSQL* m_connection = nullptr; ///< Connection the statements belong to
+    std::array<MYSQL_STMT*, STATEMENT_COUNT> m_statements{}; ///< Prepared statements, nullptr until used
+    std::array<std::array<MYSQL_BIND, MAX_PARAMS>, STATEMENT_COUNT> m_params{}; ///< Parameter bind layouts
+    CharacterRow m_row{}; ///< Shared result row
+    BatchInsert m_batchInsert{}; ///< Full size multi-row INSERT
+    BatchInsert m_tailInsert{}; ///< Multi-row INSERT for the remainder of a batch
+    std::vector<MYSQL_BIND> m_batchParams; ///< Parameter layout of multi-row INSERTs
+};
+
+#endif // STATEMENTCACHE_H
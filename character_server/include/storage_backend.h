@@ -0,0 +1,232 @@
+/**
+ * \file storage_backend.h
+ * \brief Interface of the character storage engines
+ *
+ * This file contains the declaration of the StorageBackend interface which
+ * the session layer uses for every character operation. The MySQL backed
+ * DatabaseManager is one implementation, others keep the data elsewhere.
+ */
+
+#ifndef STORAGEBACKEND_H
+#define STORAGEBACKEND_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "protocol.h"
+
+/**
+ * \class StorageBackend
+ * \brief Abstract character store
+ *
+ * Implementations must be thread-safe: every method may be called
+ * concurrently from all worker threads.
+ */
+class StorageBackend {
+public:
+    virtual ~StorageBackend() = default;
+
+    /**
+     * \brief Adds a new character
+     * \param character CharacterData object containing character information
+     * \return true if operation was successful, false otherwise
+     */
+    virtual bool addCharacter(const CharacterData& character) = 0;
+
+    /**
+     * \brief Adds a new character straight from a received request
+     * \param character View of the character, valid for the duration of the call
+     * \return true if operation was successful, false otherwise
+     * \note The default copies the view into a CharacterData, backends that
+     *       only pass the fields on override it to avoid the copy.
+     */
+    virtual bool addCharacter(const CharacterView& character) {
+        return addCharacter(character.toData());
+    }
+
+    /**
+     * \brief Adds many characters at once
+     * \param characters Characters to insert, their ids are ignored
+     * \return Generated ids in the order of the input, empty optional if
+     *         nothing was added
+     */
+    virtual std::optional<std::vector<int32_t>> addCharacters(const std::vector<CharacterData>& characters) = 0;
+
+    /**
+     * \brief Updates an existing character
+     * \param id ID of the character to update
+     * \param character CharacterData object with updated information
+     * \return true if operation was successful, false otherwise
+     */
+    virtual bool updateCharacter(int id, const CharacterData& character) = 0;
+
+    /**
+     * \brief Updates an existing character straight from a received request
+     * \param id ID of the character to update
+     * \param character View of the updated information, valid for the duration of the call
+     * \return true if operation was successful, false otherwise
+     * \note The default copies the view into a CharacterData.
+     */
+    virtual bool updateCharacter(int id, const CharacterView& character) {
+        return updateCharacter(id, character.toData());
+    }
+
+    /**
+     * \brief Deletes a character
+     * \param id ID of the character to delete
+     * \return true if operation was successful, false otherwise
+     */
+    virtual bool deleteCharacter(int id) = 0;
+
+    /**
+     * \brief Retrieves all characters
+     * \return Vector of CharacterData objects for all characters
+     */
+    virtual std::vector<CharacterData> getAllCharacters() = 0;
+
+    /**
+     * \brief Receives one serialized chunk of a character stream
+     *
+     * The chunk uses the CharacterData::serializeVector format. Returning
+     * false stops the stream.
+     */
+    using ChunkSink = std::function<bool(std::vector<uint8_t>&& chunk)>;
+
+    /**
+     * \brief Streams all characters in serialized chunks
+     * \param chunkSize Payload size after which a chunk is handed to the sink
+     * \param sink Callback receiving every non-empty chunk in order
+     * \return true if every character was streamed, false on error or if the sink stopped
+     */
+    virtual bool streamAllCharacters(size_t chunkSize, const ChunkSink& sink) = 0;
+
+    /**
+     * \brief Serializes the characters following an id into one stream chunk
+     * \param afterId Last id already streamed, empty to start at the first id,
+     *        advanced to the last id in the chunk
+     * \param chunkSize Largest chunk, only a single character larger than
+     *        that makes a bigger one
+     * \param chunk Receives the chunk in the CharacterData::serializeVector
+     *        format, without characters once every id was streamed
+     * \return false on error
+     * \note Nothing is held between calls, so a reader may take as long as it
+     *       likes for a chunk. Pages of up to Protocol::STREAM_PAGE_ROWS
+     *       characters are read with readStreamPage(), and the chunk ends
+     *       before the character that would take it past chunkSize.
+     */
+    virtual bool readStreamChunk(std::optional<int32_t>& afterId, size_t chunkSize,
+                                 std::vector<uint8_t>& chunk) {
+        uint32_t count = 0;
+        chunk.assign(sizeof(count), 0);
+        chunk.reserve(chunkSize + chunkSize / 4);
+
+        std::vector<CharacterData> page;
+        size_t rows = Protocol::STREAM_PAGE_ROWS;
+        bool full = false;
+        do {
+            page.clear();
+            if (!readStreamPage(afterId, rows, page)) {
+                return false;
+            }
+            for (const auto& character : page) {
+                // Left for the next chunk, afterId still points before it
+                if (count > 0 && chunk.size() + sizeof(uint32_t) + character.serializedSize() > chunkSize) {
+                    full = true;
+                    break;
+                }
+                character.appendTo(chunk);
+                ++count;
+                afterId = character.id;
+            }
+            if (full || page.size() < rows) break;
+
+            // Later pages are sized from the characters seen so far, so little is read past the chunk
+            if (chunk.size() < chunkSize) {
+                size_t averageSize = (chunk.size() - sizeof(count)) / count;
+                rows = std::min(Protocol::STREAM_PAGE_ROWS, (chunkSize - chunk.size()) / averageSize + 1);
+            }
+        } while (chunk.size() < chunkSize);
+
+        std::memcpy(chunk.data(), &count, sizeof(count));
+        return true;
+    }
+
+    /**
+     * \brief Retrieves a specific character
+     * \param id ID of the character to retrieve
+     * \return Optional containing CharacterData if found, empty optional otherwise
+     */
+    virtual std::optional<CharacterData> getCharacter(int id) = 0;
+
+    /**
+     * \brief Retrieves a character if that needs no blocking I/O
+     * \param id ID of the character to retrieve
+     * \param character Receives the character, empty optional if it does not exist
+     * \return true if answered, false if the lookup has to go through
+     *         getCharacter() on a worker thread
+     * \note Called on I/O threads. The default never answers.
+     */
+    virtual bool tryGetCharacter(int id, std::optional<CharacterData>& character) {
+        (void)id;
+        (void)character;
+        return false;
+    }
+
+    /**
+     * \brief Tells whether single-character writes can block
+     * \return true if addCharacter(), updateCharacter() and deleteCharacter()
+     *         return without waiting for I/O and may run on I/O threads
+     */
+    virtual bool hasNonBlockingWrites() const { return false; }
+
+    /**
+     * \brief Retrieves several characters at once
+     * \param ids IDs of the characters to retrieve, duplicates allowed
+     * \return One entry per id in the order of ids, empty optional if not found
+     * \note The default looks every id up with getCharacter(), backends with
+     *       a per-call round trip override it to fetch all ids together.
+     */
+    virtual std::vector<std::optional<CharacterData>> getCharacters(const std::vector<int32_t>& ids) {
+        std::vector<std::optional<CharacterData>> characters;
+        characters.reserve(ids.size());
+        for (int32_t id : ids) {
+            characters.push_back(getCharacter(id));
+        }
+        return characters;
+    }
+
+    /**
+     * \brief Retrieves one page of characters ordered by id
+     * \param afterId Only ids past this one in the requested order are returned,
+     *        empty optional to start at the first id
+     * \param limit Maximum number of characters
+     * \param descending Order by descending instead of ascending id
+     * \return Up to limit characters in the requested order
+     * \throw std::runtime_error if the backend fails to read the page, an
+     *        empty result always means there are no more ids
+     */
+    virtual std::vector<CharacterData> getCharacterRange(std::optional<int32_t> afterId,
+                                                         size_t limit, bool descending) = 0;
+
+protected:
+    /**
+     * \brief Reads one page of a stream in ascending id order
+     * \param afterId Only ids past this one are returned, empty to start at the first id
+     * \param limit Maximum number of characters
+     * \param page Receives up to limit characters
+     * \return false on error
+     * \note The default uses getCharacterRange(), backends that can tell an
+     *       error from an empty page override it.
+     */
+    virtual bool readStreamPage(std::optional<int32_t> afterId, size_t limit,
+                                std::vector<CharacterData>& page) {
+        page = getCharacterRange(afterId, limit, false);
+        return true;
+    }
+};
+
+#endif // STORAGEBACKEND_H
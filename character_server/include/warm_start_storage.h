@@ -0,0 +1,111 @@
+/**
+ * \file warm_start_storage.h
+ * \brief Storage wrapper serving reads from a snapshot during startup
+ *
+ * This file contains the declaration of the WarmStartStorage class which puts
+ * a mapped Snapshot in front of a storage backend that is still connecting.
+ */
+
+#ifndef WARMSTARTSTORAGE_H
+#define WARMSTARTSTORAGE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "snapshot.h"
+#include "storage_backend.h"
+
+/**
+ * \class WarmStartStorage
+ * \brief StorageBackend answering from a snapshot until the live backend is up
+ *
+ * The live backend is opened on a background thread, retried until it
+ * succeeds. Meanwhile reads are answered from the snapshot and writes wait
+ * for the live backend.
+ *
+ * Once the live backend is open every read goes to it and the snapshot is
+ * unmapped as soon as the last read still using it returns. Since writes
+ * wait for the live backend, no read ever sees the snapshot after a write.
+ */
+class WarmStartStorage : public StorageBackend {
+public:
+    /// Opens the live backend, returns nullptr on failure. Called on a background thread.
+    using Opener = std::function<StorageBackend*()>;
+
+    /// Time between attempts to open the live backend.
+    static constexpr std::chrono::seconds RETRY_INTERVAL{2};
+
+    /// Longest time a write waits for the live backend before failing.
+    static constexpr std::chrono::seconds WRITE_WAIT_TIMEOUT{30};
+
+    /**
+     * \brief Starts opening the live backend in the background
+     * \param snapshot Mapped snapshot answering reads
+     * \param openLive Opens the live backend
+     */
+    WarmStartStorage(std::unique_ptr<Snapshot> snapshot, Opener openLive);
+
+    /**
+     * \brief Destructor that stops the background thread
+     */
+    ~WarmStartStorage() override;
+
+    // Prevent copying and assignment
+    WarmStartStorage(const WarmStartStorage&) = delete;
+    WarmStartStorage& operator=(const WarmStartStorage&) = delete;
+
+    /**
+     * \brief Gets the live backend
+     * \return Live backend, nullptr while it is not open yet
+     */
+    StorageBackend* live();
+
+    bool addCharacter(const CharacterData& character) override;
+    bool addCharacter(const CharacterView& character) override;
+    std::optional<std::vector<int32_t>> addCharacters(const std::vector<CharacterData>& characters) override;
+    bool updateCharacter(int id, const CharacterData& character) override;
+    bool updateCharacter(int id, const CharacterView& character) override;
+    bool deleteCharacter(int id) override;
+    std::vector<CharacterData> getAllCharacters() override;
+    bool streamAllCharacters(size_t chunkSize, const ChunkSink& sink) override;
+    bool readStreamChunk(std::optional<int32_t>& afterId, size_t chunkSize,
+                         std::vector<uint8_t>& chunk) override;
+    std::optional<CharacterData> getCharacter(int id) override;
+    bool tryGetCharacter(int id, std::optional<CharacterData>& character) override;
+    std::vector<std::optional<CharacterData>> getCharacters(const std::vector<int32_t>& ids) override;
+    std::vector<CharacterData> getCharacterRange(std::optional<int32_t> afterId,
+                                                 size_t limit, bool descending) override;
+
+private:
+    /// Opens the live backend, runs on m_thread.
+    void connectLoop();
+
+    /**
+     * \brief Waits for the live backend
+     * \return Live backend, nullptr on timeout or shutdown
+     */
+    StorageBackend* waitLive();
+
+    /**
+     * \brief Picks the source of a read
+     * \param live Receives the live backend, nullptr while it is not open yet
+     * \return Snapshot while the live backend is not open, nullptr afterwards
+     */
+    std::shared_ptr<const Snapshot> readSource(StorageBackend*& live);
+
+    Opener m_openLive; ///< Opens the live backend
+
+    std::mutex m_mutex; ///< Protects m_snapshot, m_live and m_stopping
+    std::condition_variable m_liveReady; ///< Signalled once m_live is set or on shutdown
+    std::shared_ptr<const Snapshot> m_snapshot; ///< Data as of the last shutdown, released once m_live is set
+    StorageBackend* m_live = nullptr; ///< Live backend once open
+    bool m_stopping = false; ///< Stops the background thread
+
+    std::thread m_thread; ///< Runs connectLoop()
+};
+
+#endif // WARMSTARTSTORAGE_H
@@ -0,0 +1,309 @@
+/**
+ * \file wire_format.h
+ * \brief Compile-time description of serialized message layouts
+ *
+ * This file contains the Wire::Field and Wire::Layout templates. A message
+ * type lists its fields once, in wire order, and gets its encoder, decoder,
+ * exact size calculation and bounds checks generated from that list, for
+ * every encoding.
+ */
+
+#ifndef WIREFORMAT_H
+#define WIREFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace Wire {
+
+/// Encoding tag: integers as their little endian bytes, uint32 string lengths.
+struct Fixed {};
+
+/// Encoding tag: LEB128 varint lengths and unsigned integers, zigzag varint
+/// signed integers. Single byte integers stay raw.
+struct Compact {};
+
+/// Encoding chosen at run time, selects Fixed or Compact.
+enum class Mode {
+    Fixed,
+    Compact
+};
+
+/**
+ * \brief Gets the encoded size of a varint.
+ * \param value Value to encode.
+ * \return 1 to 5 bytes.
+ */
+constexpr size_t varintSize(uint32_t value) {
+    return 1 + (value >= (1u << 7)) + (value >= (1u << 14)) + (value >= (1u << 21)) + (value >= (1u << 28));
+}
+
+/**
+ * \brief Writes a LEB128 varint.
+ * \param out Receives varintSize(value) bytes, advanced past them.
+ * \param value Value to encode.
+ */
+inline void encodeVarint(uint8_t*& out, uint32_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+}
+
+/**
+ * \brief Reads a LEB128 varint with a bounds check.
+ * \param data Encoded data.
+ * \param size Number of readable bytes at data.
+ * \param offset Position of the varint, advanced past it.
+ * \param value Receives the value.
+ * \return false if the varint is truncated or does not fit 32 bits.
+ */
+inline bool decodeVarint(const uint8_t* data, size_t size, size_t& offset, uint32_t& value) {
+    // Lengths below 128 are the common case, they take one compare
+    if (offset < size && data[offset] < 0x80) {
+        value = data[offset++];
+        return true;
+    }
+    uint32_t result = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        if (offset == size) {
+            return false;
+        }
+        uint8_t byte = data[offset++];
+        result |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            // The fifth byte only has 4 bits left
+            if (shift == 28 && byte > 0x0F) {
+                return false;
+            }
+            value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Maps signed to unsigned so small magnitudes get short varints.
+constexpr uint32_t zigzagEncode(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+/// Inverse of zigzagEncode().
+constexpr int32_t zigzagDecode(uint32_t value) {
+    return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+/**
+ * \struct Codec
+ * \brief Encoding of one field type
+ * \tparam T Field type
+ * \tparam Encoding Fixed or Compact
+ *
+ * Every codec provides:
+ * - minSize: bytes the field takes at least
+ * - size(value): bytes the value takes
+ * - encode(out, value): writes the value and advances out
+ * - decode(data, size, offset, value): reads the value if it fits in size,
+ *   advances offset and returns false otherwise
+ */
+template<typename T, typename Encoding = Fixed, typename = void>
+struct Codec;
+
+/// Raw little endian bytes, Fixed integers and all single byte integers.
+template<typename T>
+struct RawCodec {
+    static constexpr size_t minSize = sizeof(T);
+
+    static constexpr size_t size(const T&) { return sizeof(T); }
+
+    static void encode(uint8_t*& out, const T& value) {
+        std::memcpy(out, &value, sizeof(T));
+        out += sizeof(T);
+    }
+
+    static bool decode(const uint8_t* data, size_t size, size_t& offset, T& value) {
+        if (size - offset < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+};
+
+template<typename T>
+struct Codec<T, Fixed, std::enable_if_t<std::is_arithmetic_v<T>>> : RawCodec<T> {};
+
+template<typename T>
+struct Codec<T, Compact, std::enable_if_t<std::is_arithmetic_v<T> && sizeof(T) == 1>> : RawCodec<T> {};
+
+/// Varint unsigned 32 bit integers.
+template<>
+struct Codec<uint32_t, Compact> {
+    static constexpr size_t minSize = 1;
+
+    static constexpr size_t size(const uint32_t& value) { return varintSize(value); }
+
+    static void encode(uint8_t*& out, const uint32_t& value) { encodeVarint(out, value); }
+
+    static bool decode(const uint8_t* data, size_t size, size_t& offset, uint32_t& value) {
+        return decodeVarint(data, size, offset, value);
+    }
+};
+
+/// Zigzag varint signed 32 bit integers.
+template<>
+struct Codec<int32_t, Compact> {
+    static constexpr size_t minSize = 1;
+
+    static constexpr size_t size(const int32_t& value) { return varintSize(zigzagEncode(value)); }
+
+    static void encode(uint8_t*& out, const int32_t& value) { encodeVarint(out, zigzagEncode(value)); }
+
+    static bool decode(const uint8_t* data, size_t size, size_t& offset, int32_t& value) {
+        uint32_t encoded = 0;
+        if (!decodeVarint(data, size, offset, encoded)) {
+            return false;
+        }
+        value = zigzagDecode(encoded);
+        return true;
+    }
+};
+
+/// Length prefixed strings, Str owns or views the decoded bytes.
+template<typename Str, typename Encoding>
+struct StringCodec {
+    using Length = Codec<uint32_t, Encoding>; ///< Encoding of the length prefix
+
+    static constexpr size_t minSize = Length::minSize;
+
+    static size_t size(const Str& value) {
+        return Length::size(static_cast<uint32_t>(value.size())) + value.size();
+    }
+
+    static void encode(uint8_t*& out, const Str& value) {
+        Length::encode(out, static_cast<uint32_t>(value.size()));
+        std::memcpy(out, value.data(), value.size());
+        out += value.size();
+    }
+
+    static bool decode(const uint8_t* data, size_t size, size_t& offset, Str& value) {
+        uint32_t length = 0;
+        if (!Length::decode(data, size, offset, length) || size - offset < length) {
+            return false;
+        }
+        value = Str(reinterpret_cast<const char*>(data + offset), length);
+        offset += length;
+        return true;
+    }
+};
+
+template<typename Encoding>
+struct Codec<std::string, Encoding> : StringCodec<std::string, Encoding> {};
+
+/// Decoded views point into the decoded buffer.
+template<typename Encoding>
+struct Codec<std::string_view, Encoding> : StringCodec<std::string_view, Encoding> {};
+
+/// Splits a pointer to member into its class and member type.
+template<typename Pointer>
+struct MemberPointer;
+
+template<typename Owner_, typename Type_>
+struct MemberPointer<Type_ Owner_::*> {
+    using Owner = Owner_;
+    using Type = Type_;
+};
+
+/**
+ * \struct Field
+ * \brief One serialized data member
+ * \tparam Member Pointer to the data member, its type selects the Codec
+ */
+template<auto Member>
+struct Field {
+    using Owner = typename MemberPointer<decltype(Member)>::Owner; ///< Message type
+    using Type = typename MemberPointer<decltype(Member)>::Type; ///< Member type
+
+    /// Encoding of the member.
+    template<typename Encoding>
+    using Coding = Codec<Type, Encoding>;
+
+    template<typename Encoding>
+    static constexpr size_t minSize = Coding<Encoding>::minSize;
+
+    template<typename Encoding>
+    static size_t size(const Owner& message) { return Coding<Encoding>::size(message.*Member); }
+
+    template<typename Encoding>
+    static void encode(uint8_t*& out, const Owner& message) { Coding<Encoding>::encode(out, message.*Member); }
+
+    template<typename Encoding>
+    static bool decode(const uint8_t* data, size_t size, size_t& offset, Owner& message) {
+        return Coding<Encoding>::decode(data, size, offset, message.*Member);
+    }
+};
+
+/**
+ * \struct Layout
+ * \brief Serialized form of a message, its fields back to back in list order
+ * \tparam Fields Field of every serialized member, in wire order
+ *
+ * All functions take the encoding as their first template argument and
+ * expand to straight-line code over the field list, there is no per-field
+ * dispatch at run time.
+ */
+template<typename... Fields>
+struct Layout {
+    /// Smallest possible encoded size, empty strings and the shortest integers.
+    template<typename Encoding = Fixed>
+    static constexpr size_t minSize = (Fields::template minSize<Encoding> + ...);
+
+    /**
+     * \brief Gets the exact encoded size of a message.
+     * \param message The message.
+     * \return Number of bytes encode() writes.
+     */
+    template<typename Encoding = Fixed, typename Message>
+    static size_t size(const Message& message) {
+        return (Fields::template size<Encoding>(message) + ...);
+    }
+
+    /**
+     * \brief Encodes a message in place.
+     * \param message The message.
+     * \param out Receives size(message) bytes.
+     * \return Number of bytes written.
+     */
+    template<typename Encoding = Fixed, typename Message>
+    static size_t encode(const Message& message, uint8_t* out) {
+        uint8_t* position = out;
+        (Fields::template encode<Encoding>(position, message), ...);
+        return static_cast<size_t>(position - out);
+    }
+
+    /**
+     * \brief Decodes a message, checking every field against the buffer.
+     * \param data Encoded message.
+     * \param size Number of readable bytes at data, trailing bytes are ignored.
+     * \param message Receives the fields, partially filled if decoding fails.
+     * \return true if the message was complete.
+     */
+    template<typename Encoding = Fixed, typename Message>
+    static bool decode(const uint8_t* data, size_t size, Message& message) {
+        if (size < minSize<Encoding>) {
+            return false;
+        }
+        size_t offset = 0;
+        return (Fields::template decode<Encoding>(data, size, offset, message) && ...);
+    }
+};
+
+}
+
+#endif // WIREFORMAT_H
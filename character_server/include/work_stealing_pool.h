@@ -0,0 +1,242 @@
+/**
+ * \file work_stealing_pool.h
+ * \brief Work-stealing thread pool usable as a Boost.Asio execution context
+ */
+
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <boost/asio/execution_context.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * \class WorkStealingPool
+ * \brief Thread pool with one run queue per worker
+ *
+ * Handlers posted from outside the pool are spread round-robin over the
+ * workers' queues. A handler posted by a worker goes to that worker's LIFO
+ * slot and runs next on the same thread while its data is still in cache;
+ * the handler it displaces moves to the back of the worker's queue. A worker
+ * runs its LIFO slot, then its own queue from the front, and once both are
+ * empty steals half of another worker's queue. Idle workers sleep until work
+ * is posted.
+ *
+ * The pool is an execution_context, so boost::asio::post(pool, handler)
+ * works like it does with boost::asio::thread_pool.
+ */
+class WorkStealingPool : public boost::asio::execution_context {
+public:
+    /**
+     * \struct Stats
+     * \brief Counters of the pool since it was started
+     */
+    struct Stats {
+        size_t threads = 0; ///< Worker threads
+        uint64_t executed = 0; ///< Handlers run
+        uint64_t stolen = 0; ///< Handlers taken from another worker's queue
+        uint64_t lifoHits = 0; ///< Handlers run from a LIFO slot
+        size_t queued = 0; ///< Handlers waiting right now
+        size_t maxQueued = 0; ///< Highest number of waiting handlers seen
+        std::vector<size_t> queueDepths; ///< Handlers waiting per worker, LIFO slot included
+    };
+
+    /**
+     * \class executor_type
+     * \brief Executor submitting handlers to the pool
+     */
+    class executor_type {
+    public:
+        /// Gets the pool the executor submits to.
+        WorkStealingPool& context() const noexcept { return *m_pool; }
+
+        // Workers run until join(), so outstanding work needs no tracking
+        void on_work_started() const noexcept {}
+        void on_work_finished() const noexcept {}
+
+        /// Runs the handler right away on a worker of this pool, posts it otherwise.
+        template<typename Function, typename Allocator>
+        void dispatch(Function&& function, const Allocator&) const {
+            if (m_pool->runningInThisThread()) {
+                std::decay_t<Function> handler(std::forward<Function>(function));
+                handler();
+                return;
+            }
+            m_pool->submit(makeTask(std::forward<Function>(function)), true);
+        }
+
+        /// Queues the handler, into the LIFO slot if called on a worker.
+        template<typename Function, typename Allocator>
+        void post(Function&& function, const Allocator&) const {
+            m_pool->submit(makeTask(std::forward<Function>(function)), true);
+        }
+
+        /// Queues the handler behind the ones already waiting.
+        template<typename Function, typename Allocator>
+        void defer(Function&& function, const Allocator&) const {
+            m_pool->submit(makeTask(std::forward<Function>(function)), false);
+        }
+
+        friend bool operator==(const executor_type& a, const executor_type& b) noexcept {
+            return a.m_pool == b.m_pool;
+        }
+
+        friend bool operator!=(const executor_type& a, const executor_type& b) noexcept {
+            return a.m_pool != b.m_pool;
+        }
+
+    private:
+        friend class WorkStealingPool;
+
+        explicit executor_type(WorkStealingPool& pool) noexcept : m_pool(&pool) {}
+
+        WorkStealingPool* m_pool; ///< Pool receiving the handlers
+    };
+
+    /**
+     * \brief Starts the workers
+     * \param threads Number of workers, 0 for defaultSize()
+     */
+    explicit WorkStealingPool(size_t threads = 0);
+
+    /**
+     * \brief Destructor that joins the workers
+     */
+    ~WorkStealingPool();
+
+    // Prevent copying and assignment
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * \brief Gets the default number of workers
+     * \return Twice the hardware concurrency, workers spend much of their time
+     *         blocked on the database
+     */
+    static size_t defaultSize();
+
+    /**
+     * \brief Gets an executor submitting to this pool
+     * \return Executor
+     */
+    executor_type get_executor() noexcept { return executor_type(*this); }
+
+    /**
+     * \brief Runs the handlers still queued, then stops the workers
+     * \note Handlers posted after join() returns are not run.
+     */
+    void join();
+
+    /**
+     * \brief Gets the pool counters
+     * \return Counter snapshot
+     */
+    Stats stats() const;
+
+private:
+    /**
+     * \class Task
+     * \brief Type-erased, move-only handler
+     */
+    class Task {
+    public:
+        Task() = default;
+
+        template<typename Function,
+                 typename = std::enable_if_t<!std::is_same_v<std::decay_t<Function>, Task>>>
+        explicit Task(Function&& function)
+            : m_impl(new Impl<std::decay_t<Function>>(std::forward<Function>(function))) {}
+
+        explicit operator bool() const { return m_impl != nullptr; }
+
+        /// Runs the handler and releases it.
+        void operator()() {
+            std::unique_ptr<Base> impl = std::move(m_impl);
+            impl->run();
+        }
+
+    private:
+        struct Base {
+            virtual ~Base() = default;
+            virtual void run() = 0;
+        };
+
+        template<typename Function>
+        struct Impl : Base {
+            explicit Impl(Function&& function) : function(std::move(function)) {}
+            explicit Impl(const Function& function) : function(function) {}
+            void run() override { function(); }
+            Function function;
+        };
+
+        std::unique_ptr<Base> m_impl; ///< Handler, nullptr once run
+    };
+
+    /**
+     * \struct Worker
+     * \brief Run queue of one worker thread
+     */
+    struct Worker {
+        mutable std::mutex mutex; ///< Protects lifo and queue
+        Task lifo; ///< Handler posted last by this worker, runs next
+        std::deque<Task> queue; ///< Waiting handlers, run from the front, stolen from the front
+    };
+
+    template<typename Function>
+    static Task makeTask(Function&& function) {
+        return Task(std::forward<Function>(function));
+    }
+
+    /**
+     * \brief Queues a handler
+     * \param task Handler to run
+     * \param lifo Use the LIFO slot when called on a worker
+     */
+    void submit(Task task, bool lifo);
+
+    /// Tells whether the calling thread is a worker of this pool.
+    bool runningInThisThread() const;
+
+    /// Main loop of worker index.
+    void run(size_t index);
+
+    /**
+     * \brief Takes the next handler for a worker
+     * \param index Worker looking for work
+     * \return Handler, empty if there is no work anywhere
+     */
+    Task take(size_t index);
+
+    /**
+     * \brief Moves half of another worker's queue to a worker
+     * \param index Worker looking for work
+     * \return Handler to run, empty if every other queue is empty
+     */
+    Task steal(size_t index);
+
+    std::vector<std::unique_ptr<Worker>> m_workers; ///< Run queues, one per thread
+    std::vector<std::thread> m_threads; ///< Worker threads
+
+    std::atomic<size_t> m_next{0}; ///< Round-robin position for posts from outside
+    std::atomic<size_t> m_queued{0}; ///< Handlers waiting in all queues
+    std::atomic<size_t> m_maxQueued{0}; ///< High-water mark of m_queued
+    std::atomic<size_t> m_sleeping{0}; ///< Workers waiting on m_wakeup
+    std::atomic<uint64_t> m_executed{0}; ///< Handlers run
+    std::atomic<uint64_t> m_stolen{0}; ///< Handlers stolen
+    std::atomic<uint64_t> m_lifoHits{0}; ///< Handlers run from a LIFO slot
+
+    std::mutex m_sleepMutex; ///< Guards sleeping workers against lost wakeups
+    std::condition_variable m_wakeup; ///< Signalled when work is queued or on join()
+    std::atomic<bool> m_joining{false}; ///< Workers exit once the queues are empty
+    std::mutex m_joinMutex; ///< Serializes join() calls
+};
+
+#endif // WORKSTEALINGPOOL_H
@@ -0,0 +1,387 @@
+#include "async_database.h"
+
+#include <mysql/errmsg.h>
+#include <iostream>
+
+namespace {
+
+// Builds a character from a "SELECT id, name, surname, age, bio" row
+CharacterData characterFromRow(MYSQL_ROW row, const unsigned long* lengths) {
+    CharacterData character;
+    character.id = std::stoi(row[0]);
+    character.name.assign(row[1] ? row[1] : "", row[1] ? lengths[1] : 0);
+    character.surname.assign(row[2] ? row[2] : "", row[2] ? lengths[2] : 0);
+    character.age = static_cast<uint8_t>(std::stoi(row[3]));
+    character.bio.assign(row[4] ? row[4] : "", row[4] ? lengths[4] : 0);
+    return character;
+}
+
+}
+
+AsyncDatabase::Connection::Connection(boost::asio::io_context& ioContext)
+    : timer(ioContext)
+{
+
+}
+
+AsyncDatabase::AsyncDatabase(boost::asio::io_context& ioContext, CharacterCache& cache)
+    : m_ioContext(ioContext),
+      m_strand(ioContext.get_executor()),
+      m_cache(cache)
+{
+
+}
+
+AsyncDatabase::~AsyncDatabase() {
+    for (auto& connection : m_connections) {
+        closeConnection(*connection);
+    }
+}
+
+void AsyncDatabase::initialize(const ConnectionPool::Settings& settings) {
+    m_settings = settings;
+    for (size_t i = 0; i < settings.size; ++i) {
+        m_connections.push_back(std::make_unique<Connection>(m_ioContext));
+    }
+
+    boost::asio::post(m_strand, [this]() {
+        for (auto& connection : m_connections) {
+            connect(*connection);
+        }
+    });
+}
+
+void AsyncDatabase::getCharacter(int32_t id, CharacterHandler handler) {
+    if (auto cached = m_cache.get(id)) {
+        handler(std::move(cached));
+        return;
+    }
+
+    // Taken before the query, so a concurrent update invalidates what we load
+    uint64_t token = m_cache.beginLoad(id);
+
+    Query query;
+    query.storesResult = true;
+    query.sql = [id](MYSQL*) {
+        return "SELECT id, name, surname, age, bio FROM characters WHERE id = " + std::to_string(id);
+    };
+    query.complete = [this, token, handler = std::move(handler)](bool ok, MYSQL*, MYSQL_RES* result) {
+        std::optional<CharacterData> character;
+        if (ok) {
+            if (MYSQL_ROW row = mysql_fetch_row(result)) {
+                character = characterFromRow(row, mysql_fetch_lengths(result));
+                m_cache.fill(*character, token);
+            }
+        }
+        handler(std::move(character));
+    };
+    submit(std::move(query));
+}
+
+void AsyncDatabase::getAllCharacters(CharactersHandler handler) {
+    Query query;
+    query.storesResult = true;
+    query.sql = [](MYSQL*) {
+        return std::string("SELECT id, name, surname, age, bio FROM characters");
+    };
+    query.complete = [handler = std::move(handler)](bool ok, MYSQL*, MYSQL_RES* result) {
+        if (!ok) {
+            handler(std::nullopt);
+            return;
+        }
+
+        std::vector<CharacterData> characters;
+        characters.reserve(mysql_num_rows(result));
+        while (MYSQL_ROW row = mysql_fetch_row(result)) {
+            characters.push_back(characterFromRow(row, mysql_fetch_lengths(result)));
+        }
+        handler(std::move(characters));
+    };
+    submit(std::move(query));
+}
+
+void AsyncDatabase::addCharacter(const CharacterData& character, StatusHandler handler) {
+    Query query;
+    query.sql = [character](MYSQL* mysql) {
+        std::string sql = "INSERT INTO characters (name, surname, age, bio) VALUES (";
+        appendQuoted(sql, mysql, character.name);
+        sql += ", ";
+        appendQuoted(sql, mysql, character.surname);
+        sql += ", " + std::to_string(character.age) + ", ";
+        appendQuoted(sql, mysql, character.bio);
+        sql += ")";
+        return sql;
+    };
+    query.complete = [handler = std::move(handler)](bool ok, MYSQL*, MYSQL_RES*) {
+        handler(ok);
+    };
+    submit(std::move(query));
+}
+
+void AsyncDatabase::updateCharacter(int32_t id, const CharacterData& character, StatusHandler handler) {
+    Query query;
+    query.sql = [id, character](MYSQL* mysql) {
+        std::string sql = "UPDATE characters SET name = ";
+        appendQuoted(sql, mysql, character.name);
+        sql += ", surname = ";
+        appendQuoted(sql, mysql, character.surname);
+        sql += ", age = " + std::to_string(character.age) + ", bio = ";
+        appendQuoted(sql, mysql, character.bio);
+        sql += " WHERE id = " + std::to_string(id);
+        return sql;
+    };
+    query.complete = [this, id, handler = std::move(handler)](bool ok, MYSQL*, MYSQL_RES*) {
+        m_cache.invalidate(id);
+        handler(ok);
+    };
+    submit(std::move(query));
+}
+
+void AsyncDatabase::deleteCharacter(int32_t id, StatusHandler handler) {
+    Query query;
+    query.sql = [id](MYSQL*) {
+        return "DELETE FROM characters WHERE id = " + std::to_string(id);
+    };
+    query.complete = [this, id, handler = std::move(handler)](bool ok, MYSQL*, MYSQL_RES*) {
+        m_cache.invalidate(id);
+        handler(ok);
+    };
+    submit(std::move(query));
+}
+
+void AsyncDatabase::submit(Query query) {
+    boost::asio::post(m_strand, [this, query = std::move(query)]() mutable {
+        m_pending.push_back(std::move(query));
+        for (auto& connection : m_connections) {
+            if (connection->open && connection->step == Step::Idle) {
+                dispatch(*connection);
+                return;
+            }
+        }
+        failPendingIfDisconnected();
+    });
+}
+
+void AsyncDatabase::dispatch(Connection& connection) {
+    if (!connection.open || connection.step != Step::Idle || m_pending.empty()) {
+        return;
+    }
+
+    connection.query = std::move(m_pending.front());
+    m_pending.pop_front();
+    connection.sql = connection.query.sql(connection.mysql);
+    connection.step = Step::Query;
+
+    int status = mysql_real_query_start(&connection.queryError, connection.mysql,
+                                        connection.sql.data(), connection.sql.size());
+    proceed(connection, status);
+}
+
+void AsyncDatabase::connect(Connection& connection) {
+    connection.mysql = mysql_init(nullptr);
+    if (!connection.mysql) {
+        reconnectLater(connection);
+        return;
+    }
+
+    // 5 seconds, enforced by the client library through MYSQL_WAIT_TIMEOUT
+    unsigned int timeout = 5;
+    mysql_options(connection.mysql, MYSQL_OPT_NONBLOCK, nullptr);
+    mysql_options(connection.mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    mysql_options(connection.mysql, MYSQL_OPT_READ_TIMEOUT, &timeout);
+    mysql_options(connection.mysql, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
+
+    connection.step = Step::Connect;
+    connection.connected = nullptr;
+    int status = mysql_real_connect_start(&connection.connected, connection.mysql,
+                                          m_settings.host.c_str(), m_settings.user.c_str(),
+                                          m_settings.pass.c_str(), m_settings.db.c_str(),
+                                          0, nullptr, 0);
+    proceed(connection, status);
+}
+
+void AsyncDatabase::proceed(Connection& connection, int status) {
+    while (status == 0) {
+        switch (connection.step) {
+        case Step::Connect:
+            if (!connection.connected) {
+                std::cerr << "Async MySQL connection failed: " << mysql_error(connection.mysql) << std::endl;
+                reconnectLater(connection);
+                return;
+            }
+            connection.open = true;
+            connection.step = Step::Idle;
+            ++m_connectedCount;
+            dispatch(connection);
+            return;
+
+        case Step::Query:
+            if (connection.queryError != 0) {
+                finish(connection, false);
+                return;
+            }
+            if (!connection.query.storesResult) {
+                finish(connection, true);
+                return;
+            }
+            connection.step = Step::StoreResult;
+            status = mysql_store_result_start(&connection.result, connection.mysql);
+            break;
+
+        case Step::StoreResult:
+            finish(connection, connection.result != nullptr);
+            return;
+
+        case Step::Idle:
+            return;
+        }
+    }
+
+    wait(connection, status);
+}
+
+void AsyncDatabase::wait(Connection& connection, int status) {
+    // The socket is known once the connect call returned for the first time
+    if (!connection.socket) {
+        boost::system::error_code ec;
+        connection.socket = std::make_unique<boost::asio::posix::stream_descriptor>(m_ioContext);
+        connection.socket->assign(mysql_get_socket(connection.mysql), ec);
+        if (ec) {
+            std::cerr << "Cannot watch MySQL socket: " << ec.message() << std::endl;
+            bool running = connection.step == Step::Query || connection.step == Step::StoreResult;
+            Query query = std::move(connection.query);
+            reconnectLater(connection);
+            if (running) {
+                query.complete(false, nullptr, nullptr);
+            }
+            return;
+        }
+    }
+
+    // Whichever event comes first resumes the call, the others become stale
+    uint64_t waitId = ++connection.waitId;
+    auto onReady = [this, &connection, waitId](int ready) {
+        return boost::asio::bind_executor(m_strand,
+            [this, &connection, waitId, ready](const boost::system::error_code& ec) {
+                if (ec || connection.waitId != waitId) return;
+                ++connection.waitId;
+                boost::system::error_code ignored;
+                connection.timer.cancel(ignored);
+                connection.socket->cancel(ignored);
+                resume(connection, ready);
+            });
+    };
+
+    if (status & (MYSQL_WAIT_READ | MYSQL_WAIT_EXCEPT)) {
+        connection.socket->async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                                      onReady(MYSQL_WAIT_READ));
+    }
+    if (status & MYSQL_WAIT_WRITE) {
+        connection.socket->async_wait(boost::asio::posix::stream_descriptor::wait_write,
+                                      onReady(MYSQL_WAIT_WRITE));
+    }
+    if (status & MYSQL_WAIT_TIMEOUT) {
+        connection.timer.expires_after(std::chrono::milliseconds(mysql_get_timeout_value_ms(connection.mysql)));
+        connection.timer.async_wait(onReady(MYSQL_WAIT_TIMEOUT));
+    }
+}
+
+void AsyncDatabase::resume(Connection& connection, int ready) {
+    int status = 0;
+    switch (connection.step) {
+    case Step::Connect:
+        status = mysql_real_connect_cont(&connection.connected, connection.mysql, ready);
+        break;
+    case Step::Query:
+        status = mysql_real_query_cont(&connection.queryError, connection.mysql, ready);
+        break;
+    case Step::StoreResult:
+        status = mysql_store_result_cont(&connection.result, connection.mysql, ready);
+        break;
+    case Step::Idle:
+        return;
+    }
+    proceed(connection, status);
+}
+
+void AsyncDatabase::finish(Connection& connection, bool ok) {
+    Query query = std::move(connection.query);
+    MYSQL_RES* result = connection.result;
+    connection.result = nullptr;
+    connection.step = Step::Idle;
+
+    unsigned int error = ok ? 0 : mysql_errno(connection.mysql);
+    bool broken = error == CR_SERVER_GONE_ERROR || error == CR_SERVER_LOST;
+    if (!ok) {
+        std::cerr << "Async MySQL query failed: " << mysql_error(connection.mysql) << std::endl;
+    }
+
+    // Decided before the handler runs, it may queue a query that picks this connection
+    if (broken) {
+        reconnectLater(connection);
+    }
+    query.complete(ok, connection.mysql, result);
+    if (result) {
+        mysql_free_result(result);
+    }
+    if (!broken) {
+        dispatch(connection);
+    }
+}
+
+void AsyncDatabase::reconnectLater(Connection& connection) {
+    if (connection.open) {
+        connection.open = false;
+        --m_connectedCount;
+    }
+    ++connection.waitId;
+    closeConnection(connection);
+    connection.step = Step::Idle;
+
+    connection.timer.expires_after(RECONNECT_DELAY);
+    connection.timer.async_wait(boost::asio::bind_executor(m_strand,
+        [this, &connection](const boost::system::error_code& ec) {
+            if (!ec) connect(connection);
+        }));
+
+    failPendingIfDisconnected();
+}
+
+void AsyncDatabase::failPendingIfDisconnected() {
+    if (m_connectedCount > 0) {
+        return;
+    }
+    for (auto& connection : m_connections) {
+        if (connection->step == Step::Connect) {
+            // Still coming up, the queue is served once it is open
+            return;
+        }
+    }
+
+    std::deque<Query> pending;
+    pending.swap(m_pending);
+    for (auto& query : pending) {
+        query.complete(false, nullptr, nullptr);
+    }
+}
+
+void AsyncDatabase::closeConnection(Connection& connection) {
+    if (connection.socket) {
+        // mysql_close owns the descriptor
+        connection.socket->release();
+        connection.socket.reset();
+    }
+    if (connection.mysql) {
+        mysql_close(connection.mysql);
+        connection.mysql = nullptr;
+    }
+}
+
+void AsyncDatabase::appendQuoted(std::string& sql, MYSQL* mysql, const std::string& value) {
+    sql += '\'';
+    size_t start = sql.size();
+    sql.resize(start + value.size() * 2 + 1);
+    unsigned long length = mysql_real_escape_string(mysql, &sql[start], value.data(), value.size());
+    sql.resize(start + length);
+    sql += '\'';
+}
@@ -0,0 +1,109 @@
+#include "character_cache.h"
+
+CharacterCache::CharacterCache(size_t capacityBytes, size_t shardCount) {
+    if (shardCount == 0) {
+        shardCount = 1;
+    }
+
+    m_shardCapacity = capacityBytes / shardCount;
+    m_shards.reserve(shardCount);
+    for (size_t i = 0; i < shardCount; ++i) {
+        m_shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+std::optional<CharacterData> CharacterCache::get(int32_t id, bool countMiss) {
+    Shard& shard = shardFor(id);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(id);
+        if (it != shard.index.end()) {
+            // Move to the front, it is now the most recently used entry
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            ++m_hits;
+            return *it->second;
+        }
+    }
+
+    if (countMiss) {
+        ++m_misses;
+    }
+    return std::nullopt;
+}
+
+uint64_t CharacterCache::beginLoad(int32_t id) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.invalidations;
+}
+
+void CharacterCache::fill(const CharacterData& character, uint64_t token) {
+    size_t size = entrySize(character);
+    if (size > m_shardCapacity) return;
+
+    Shard& shard = shardFor(character.id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // The id (or a neighbour in the shard) changed while it was being loaded
+    if (shard.invalidations != token) return;
+
+    auto it = shard.index.find(character.id);
+    if (it != shard.index.end()) {
+        shard.bytes -= entrySize(*it->second);
+        *it->second = character;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    } else {
+        shard.lru.push_front(character);
+        shard.index.emplace(character.id, shard.lru.begin());
+    }
+    shard.bytes += size;
+
+    while (shard.bytes > m_shardCapacity && !shard.lru.empty()) {
+        const CharacterData& victim = shard.lru.back();
+        shard.bytes -= entrySize(victim);
+        shard.index.erase(victim.id);
+        shard.lru.pop_back();
+        ++m_evictions;
+    }
+}
+
+void CharacterCache::invalidate(int32_t id) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    ++shard.invalidations;
+    auto it = shard.index.find(id);
+    if (it == shard.index.end()) return;
+
+    shard.bytes -= entrySize(*it->second);
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+}
+
+CharacterCache::Stats CharacterCache::stats() const {
+    Stats stats;
+    stats.hits = m_hits.load();
+    stats.misses = m_misses.load();
+    stats.evictions = m_evictions.load();
+
+    for (const auto& shard : m_shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        stats.entries += shard->index.size();
+        stats.bytes += shard->bytes;
+    }
+    return stats;
+}
+
+CharacterCache::Shard& CharacterCache::shardFor(int32_t id) const {
+    // Sequential ids land on consecutive shards
+    return *m_shards[static_cast<uint32_t>(id) % m_shards.size()];
+}
+
+size_t CharacterCache::entrySize(const CharacterData& character) {
+    // List node, hash node and bucket overhead, roughly
+    constexpr size_t overhead = 64;
+    return sizeof(CharacterData) + overhead +
+            character.name.size() +
+            character.surname.size() +
+            character.bio.size();
+}
@@ -0,0 +1,175 @@
+#include "connection_pool.h"
+
+#include <mysql/errmsg.h>
+#include <iostream>
+
+ConnectionPool::Handle::~Handle() {
+    release();
+}
+
+ConnectionPool::Handle::Handle(Handle&& other) noexcept
+    : m_pool(other.m_pool),
+      m_connection(other.m_connection)
+{
+    other.m_pool = nullptr;
+    other.m_connection = nullptr;
+}
+
+ConnectionPool::Handle& ConnectionPool::Handle::operator=(Handle&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_pool = other.m_pool;
+        m_connection = other.m_connection;
+        other.m_pool = nullptr;
+        other.m_connection = nullptr;
+    }
+    return *this;
+}
+
+StatementCache& ConnectionPool::Handle::statements() {
+    if (!m_connection->statements) {
+        m_connection->statements = std::make_unique<StatementCache>(m_connection->mysql);
+    }
+    return *m_connection->statements;
+}
+
+void ConnectionPool::Handle::checkError(MYSQL_STMT* stmt) {
+    if (!m_connection || !m_connection->mysql) return;
+
+    unsigned int error = stmt ? mysql_stmt_errno(stmt) : mysql_errno(m_connection->mysql);
+    if (error == CR_SERVER_GONE_ERROR || error == CR_SERVER_LOST) {
+        m_connection->broken = true;
+    }
+}
+
+void ConnectionPool::Handle::release() {
+    if (m_pool && m_connection) {
+        m_pool->release(m_connection);
+    }
+    m_pool = nullptr;
+    m_connection = nullptr;
+}
+
+ConnectionPool::~ConnectionPool() {
+    shutdown();
+}
+
+bool ConnectionPool::initialize(const Settings& settings) {
+    shutdown();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_settings = settings;
+    if (m_settings.size == 0) {
+        m_settings.size = 1;
+    }
+
+    m_connections.reserve(m_settings.size);
+    m_idle.reserve(m_settings.size);
+
+    for (size_t i = 0; i < m_settings.size; ++i) {
+        auto connection = std::make_unique<Connection>();
+        if (!connect(*connection)) {
+            std::cerr << "Failed to open pooled MySQL connection " << i + 1
+                      << " of " << m_settings.size << std::endl;
+            for (auto* idle : m_idle) {
+                mysql_close(idle->mysql);
+            }
+            m_idle.clear();
+            m_connections.clear();
+            return false;
+        }
+        m_idle.push_back(connection.get());
+        m_connections.push_back(std::move(connection));
+    }
+
+    return true;
+}
+
+void ConnectionPool::shutdown() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& connection : m_connections) {
+        connection->statements.reset();
+        if (connection->mysql) {
+            mysql_close(connection->mysql);
+            connection->mysql = nullptr;
+        }
+    }
+    m_idle.clear();
+    m_connections.clear();
+}
+
+ConnectionPool::Handle ConnectionPool::acquire() {
+    Connection* connection = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_available.wait_for(lock, m_settings.acquireTimeout,
+                                  [this] { return !m_idle.empty(); })) {
+            return Handle();
+        }
+        connection = m_idle.back();
+        m_idle.pop_back();
+    }
+
+    // Health checks run outside the pool lock, they may take a round trip
+    if (!ensureHealthy(*connection)) {
+        release(connection);
+        return Handle();
+    }
+
+    return Handle(this, connection);
+}
+
+bool ConnectionPool::connect(Connection& connection) {
+    // Statements die with the connection, they are prepared again on first use
+    connection.statements.reset();
+    if (connection.mysql) {
+        mysql_close(connection.mysql);
+    }
+
+    connection.mysql = mysql_init(nullptr);
+    if (!connection.mysql) return false;
+
+    // 5 seconds
+    unsigned int timeout = 5;
+    mysql_options(connection.mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    mysql_options(connection.mysql, MYSQL_OPT_READ_TIMEOUT, &timeout);
+    mysql_options(connection.mysql, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
+
+    if (!mysql_real_connect(connection.mysql, m_settings.host.c_str(), m_settings.user.c_str(),
+                            m_settings.pass.c_str(), m_settings.db.c_str(), 0, nullptr, 0)) {
+        mysql_close(connection.mysql);
+        connection.mysql = nullptr;
+        return false;
+    }
+
+    connection.broken = false;
+    connection.lastUsed = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool ConnectionPool::ensureHealthy(Connection& connection) {
+    if (!connection.mysql || connection.broken) {
+        return connect(connection);
+    }
+
+    auto idle = std::chrono::steady_clock::now() - connection.lastUsed;
+    if (idle < m_settings.healthCheckInterval) {
+        return true;
+    }
+
+    if (mysql_ping(connection.mysql) == 0) {
+        return true;
+    }
+
+    std::cerr << "Pooled MySQL connection lost, reconnecting" << std::endl;
+    return connect(connection);
+}
+
+void ConnectionPool::release(Connection* connection) {
+    connection->lastUsed = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle.push_back(connection);
+    }
+    m_available.notify_one();
+}
@@ -1,13 +1,15 @@
 #include "database_manager.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <sstream>
+#include <unordered_map>
 #include <iostream>
 
 DatabaseManager::~DatabaseManager() {
-    if (m_connection) {
-        mysql_close(m_connection);
-    }
+    m_pool.shutdown();
 }
 
 DatabaseManager &DatabaseManager::getInstance()
@@ -17,22 +19,16 @@ DatabaseManager &DatabaseManager::getInstance()
 }
 
 bool DatabaseManager::initialize(const std::string& host, const std::string& user,
-                                 const std::string& pass, const std::string& db) {
-    std::lock_guard<std::mutex> lock(m_dbMutex);
-
-    m_connection = mysql_init(nullptr);
-    if (!m_connection) return false;
-
-    // 5 seconds
-    unsigned int timeout = 5;
-    mysql_options(m_connection, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
-    mysql_options(m_connection, MYSQL_OPT_READ_TIMEOUT, &timeout);
-    mysql_options(m_connection, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
-
-    if (!mysql_real_connect(m_connection, host.c_str(), user.c_str(),
-                            pass.c_str(), db.c_str(), 0, nullptr, 0)) {
-        mysql_close(m_connection);
-        m_connection = nullptr;
+                                 const std::string& pass, const std::string& db,
+                                 size_t poolSize) {
+    ConnectionPool::Settings settings;
+    settings.host = host;
+    settings.user = user;
+    settings.pass = pass;
+    settings.db = db;
+    settings.size = poolSize;
+
+    if (!m_pool.initialize(settings)) {
         return false;
     }
 
@@ -44,146 +40,187 @@ bool DatabaseManager::initialize(const std::string& host, const std::string& use
             "age INT NOT NULL, "
             "bio TEXT NOT NULL) ENGINE=InnoDB";
 
-    return executeQuery(createTable);
+    if (!executeQuery(createTable)) {
+        return false;
+    }
+    if (!loadAutoIncrementSettings()) {
+        std::cerr << "Unknown AUTO_INCREMENT settings, batches are inserted row by row" << std::endl;
+    }
+    return true;
 }
 
-bool DatabaseManager::addCharacter(const CharacterData& character) {
-    std::lock_guard<std::mutex> lock(m_dbMutex);
-
-    // Prepare statement
-    std::string query = "INSERT INTO characters (name, surname, age, bio) VALUES (?, ?, ?, ?)";
-    MYSQL_STMT* stmt = mysql_stmt_init(m_connection);
-    if (!stmt) return false;
+bool DatabaseManager::loadAutoIncrementSettings() {
+    auto connection = m_pool.acquire();
+    if (!connection) return false;
 
-    if (mysql_stmt_prepare(stmt, query.c_str(), query.length()) != 0) {
-        mysql_stmt_close(stmt);
+    if (mysql_query(connection.get(), "SELECT @@auto_increment_increment, @@innodb_autoinc_lock_mode") != 0) {
+        connection.checkError();
         return false;
     }
-
-    // Bind parameters
-    MYSQL_BIND bind[4]{};
-
-    // Name
-    bind[0].buffer_type = MYSQL_TYPE_STRING;
-    bind[0].buffer = (void*)character.name.c_str();
-    bind[0].buffer_length = character.name.length();
-
-    // Surname
-    bind[1].buffer_type = MYSQL_TYPE_STRING;
-    bind[1].buffer = (void*)character.surname.c_str();
-    bind[1].buffer_length = character.surname.length();
-
-    // Age
-    bind[2].buffer_type = MYSQL_TYPE_LONG;
-    bind[2].buffer = (void*)&character.age;
-    bind[2].is_unsigned = false;
-
-    // Bio
-    bind[3].buffer_type = MYSQL_TYPE_STRING;
-    bind[3].buffer = (void*)character.bio.c_str();
-    bind[3].buffer_length = character.bio.length();
-
-    if (mysql_stmt_bind_param(stmt, bind) != 0) {
-        mysql_stmt_close(stmt);
+    MYSQL_RES* result = mysql_store_result(connection.get());
+    if (!result) {
+        connection.checkError();
         return false;
     }
 
-    // Execute
-    bool result = mysql_stmt_execute(stmt) == 0;
-    mysql_stmt_close(stmt);
-    return result;
+    bool loaded = false;
+    MYSQL_ROW row = mysql_fetch_row(result);
+    if (row && row[0] && row[1]) {
+        m_autoIncrementStep = std::max(1, std::atoi(row[0]));
+        // Lock modes 0 and 1 reserve the ids of a simple multi-row INSERT
+        // together, mode 2 interleaves them with concurrent statements
+        m_consecutiveIds = std::atoi(row[1]) != 2;
+        loaded = true;
+    }
+    mysql_free_result(result);
+    return loaded;
 }
 
-bool DatabaseManager::updateCharacter(int id, const CharacterData& character) {
-    std::lock_guard<std::mutex> lock(m_dbMutex);
-
-    std::string query =
-            "UPDATE characters SET name = ?, surname = ?, age = ?, bio = ? "
-            "WHERE id = ?";
+bool DatabaseManager::addCharacter(const CharacterData& character) {
+    return addCharacter(character.view());
+}
 
-    MYSQL_STMT* stmt = mysql_stmt_init(m_connection);
-    if (!stmt) return false;
+bool DatabaseManager::addCharacter(const CharacterView& character) {
+    // Parameters point into the request, nothing is copied before the execute
+    auto connection = m_pool.acquire();
+    if (!connection) return false;
 
-    if (mysql_stmt_prepare(stmt, query.c_str(), query.length()) != 0) {
-        mysql_stmt_close(stmt);
-        return false;
-    }
+    MYSQL_BIND* bind = connection.statements().params(StatementCache::INSERT_CHARACTER);
+    StatementCache::bindString(bind[0], character.name);
+    StatementCache::bindString(bind[1], character.surname);
+    StatementCache::bindValue(bind[2], character.age);
+    StatementCache::bindString(bind[3], character.bio);
 
-    MYSQL_BIND bind[5]{};
+    return execute(connection, StatementCache::INSERT_CHARACTER) != nullptr;
+}
 
-    // Name
-    bind[0].buffer_type = MYSQL_TYPE_STRING;
-    bind[0].buffer = (void*)character.name.c_str();
-    bind[0].buffer_length = character.name.length();
+std::optional<std::vector<int32_t>> DatabaseManager::addCharacters(const std::vector<CharacterData>& characters) {
+    std::vector<int32_t> ids;
+    if (characters.empty()) return ids;
 
-    // Surname
-    bind[1].buffer_type = MYSQL_TYPE_STRING;
-    bind[1].buffer = (void*)character.surname.c_str();
-    bind[1].buffer_length = character.surname.length();
+    auto connection = m_pool.acquire();
+    if (!connection) return std::nullopt;
 
-    // Age
-    bind[2].buffer_type = MYSQL_TYPE_LONG;
-    bind[2].buffer = (void*)&character.age;
-    bind[2].is_unsigned = false;
+    if (mysql_query(connection.get(), "START TRANSACTION") != 0) {
+        connection.checkError();
+        return std::nullopt;
+    }
 
-    // Bio
-    bind[3].buffer_type = MYSQL_TYPE_STRING;
-    bind[3].buffer = (void*)character.bio.c_str();
-    bind[3].buffer_length = character.bio.length();
+    auto rollback = [&connection]() {
+        connection.checkError();
+        mysql_rollback(connection.get());
+        return std::nullopt;
+    };
+
+    auto& statements = connection.statements();
+    ids.reserve(characters.size());
+
+    if (!m_consecutiveIds) {
+        // Ids of a multi-row INSERT could have gaps, each row reports its own
+        MYSQL_BIND* bind = statements.params(StatementCache::INSERT_CHARACTER);
+        for (const auto& character : characters) {
+            StatementCache::bindString(bind[0], character.name);
+            StatementCache::bindString(bind[1], character.surname);
+            StatementCache::bindValue(bind[2], character.age);
+            StatementCache::bindString(bind[3], character.bio);
+
+            MYSQL_STMT* stmt = execute(connection, StatementCache::INSERT_CHARACTER);
+            if (!stmt) {
+                mysql_rollback(connection.get());
+                return std::nullopt;
+            }
+            ids.push_back(static_cast<int32_t>(mysql_stmt_insert_id(stmt)));
+        }
+
+        if (mysql_commit(connection.get()) != 0) {
+            return rollback();
+        }
+        return ids;
+    }
 
-    // ID
-    bind[4].buffer_type = MYSQL_TYPE_LONG;
-    bind[4].buffer = (void*)&id;
-    bind[4].is_unsigned = false;
+    MYSQL_BIND* bind = statements.batchParams();
+    for (size_t offset = 0; offset < characters.size(); offset += StatementCache::BATCH_INSERT_ROWS) {
+        size_t rows = std::min(StatementCache::BATCH_INSERT_ROWS, characters.size() - offset);
+
+        MYSQL_STMT* stmt = statements.getBatchInsert(rows);
+        if (!stmt) {
+            return rollback();
+        }
+
+        for (size_t row = 0; row < rows; ++row) {
+            const CharacterData& character = characters[offset + row];
+            MYSQL_BIND* rowBind = bind + row * StatementCache::BATCH_INSERT_PARAMS;
+            StatementCache::bindString(rowBind[0], character.name);
+            StatementCache::bindString(rowBind[1], character.surname);
+            StatementCache::bindValue(rowBind[2], character.age);
+            StatementCache::bindString(rowBind[3], character.bio);
+        }
+
+        if (mysql_stmt_bind_param(stmt, bind) != 0 || mysql_stmt_execute(stmt) != 0) {
+            connection.checkError(stmt);
+            mysql_rollback(connection.get());
+            return std::nullopt;
+        }
+
+        // The insert id is the first one, the others follow at the configured step
+        auto firstId = static_cast<int32_t>(mysql_stmt_insert_id(stmt));
+        for (size_t row = 0; row < rows; ++row) {
+            ids.push_back(firstId + static_cast<int32_t>(row) * m_autoIncrementStep);
+        }
+    }
 
-    if (mysql_stmt_bind_param(stmt, bind) != 0) {
-        mysql_stmt_close(stmt);
-        return false;
+    if (mysql_commit(connection.get()) != 0) {
+        return rollback();
     }
+    return ids;
+}
 
-    bool result = mysql_stmt_execute(stmt) == 0;
-    mysql_stmt_close(stmt);
-    return result;
+bool DatabaseManager::updateCharacter(int id, const CharacterData& character) {
+    return updateCharacter(id, character.view());
 }
 
-bool DatabaseManager::deleteCharacter(int id) {
-    std::lock_guard<std::mutex> lock(m_dbMutex);
+bool DatabaseManager::updateCharacter(int id, const CharacterView& character) {
+    auto connection = m_pool.acquire();
+    if (!connection) return false;
 
-    std::string query = "DELETE FROM characters WHERE id = ?";
-    MYSQL_STMT* stmt = mysql_stmt_init(m_connection);
-    if (!stmt) return false;
+    MYSQL_BIND* bind = connection.statements().params(StatementCache::UPDATE_CHARACTER);
+    StatementCache::bindString(bind[0], character.name);
+    StatementCache::bindString(bind[1], character.surname);
+    StatementCache::bindValue(bind[2], character.age);
+    StatementCache::bindString(bind[3], character.bio);
+    StatementCache::bindValue(bind[4], id);
 
-    if (mysql_stmt_prepare(stmt, query.c_str(), query.length()) != 0) {
-        mysql_stmt_close(stmt);
-        return false;
-    }
+    bool result = execute(connection, StatementCache::UPDATE_CHARACTER) != nullptr;
+    m_cache.invalidate(id);
+    return result;
+}
 
-    MYSQL_BIND bind{};
-    bind.buffer_type = MYSQL_TYPE_LONG;
-    bind.buffer = (void*)&id;
-    bind.is_unsigned = false;
+bool DatabaseManager::deleteCharacter(int id) {
+    auto connection = m_pool.acquire();
+    if (!connection) return false;
 
-    if (mysql_stmt_bind_param(stmt, &bind) != 0) {
-        mysql_stmt_close(stmt);
-        return false;
-    }
+    MYSQL_BIND* bind = connection.statements().params(StatementCache::DELETE_CHARACTER);
+    StatementCache::bindValue(bind[0], id);
 
-    bool result = mysql_stmt_execute(stmt) == 0;
-    mysql_stmt_close(stmt);
+    bool result = execute(connection, StatementCache::DELETE_CHARACTER) != nullptr;
+    m_cache.invalidate(id);
     return result;
 }
 
 std::vector<CharacterData> DatabaseManager::getAllCharacters() {
-    std::lock_guard<std::mutex> lock(m_dbMutex);
     std::vector<CharacterData> characters;
+    auto connection = m_pool.acquire();
+    if (!connection) return characters;
 
     std::string query = "SELECT id, name, surname, age, bio FROM characters";
-    if (mysql_query(m_connection, query.c_str())) {
+    if (mysql_query(connection.get(), query.c_str())) {
+        connection.checkError();
         return characters;
     }
 
-    MYSQL_RES* result = mysql_store_result(m_connection);
+    MYSQL_RES* result = mysql_store_result(connection.get());
     if (!result) {
+        connection.checkError();
         return characters;
     }
 
@@ -202,98 +239,264 @@ std::vector<CharacterData> DatabaseManager::getAllCharacters() {
     return characters;
 }
 
+bool DatabaseManager::streamAllCharacters(size_t chunkSize, const ChunkSink& sink) {
+    auto connection = m_pool.acquire();
+    if (!connection) return false;
+
+    std::string query = "SELECT id, name, surname, age, bio FROM characters";
+    if (mysql_query(connection.get(), query.c_str())) {
+        connection.checkError();
+        return false;
+    }
+
+    // Rows are pulled from the server one by one instead of buffering the table
+    MYSQL_RES* result = mysql_use_result(connection.get());
+    if (!result) {
+        connection.checkError();
+        return false;
+    }
+
+    std::vector<uint8_t> chunk;
+    uint32_t count = 0;
+    auto startChunk = [&]() {
+        chunk.clear();
+        chunk.reserve(chunkSize + chunkSize / 4);
+        count = 0;
+        chunk.resize(sizeof(count));
+    };
+    auto finishChunk = [&]() {
+        std::memcpy(chunk.data(), &count, sizeof(count));
+        return sink(std::move(chunk));
+    };
+    auto assignColumn = [](std::string& field, const char* value, unsigned long length) {
+        if (value) {
+            field.assign(value, length);
+        } else {
+            field.clear();
+        }
+    };
+
+    // Reused for every row so string capacity carries over
+    CharacterData character;
+    bool completed = true;
+    startChunk();
+
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        unsigned long* lengths = mysql_fetch_lengths(result);
+        character.id = std::stoi(row[0]);
+        assignColumn(character.name, row[1], lengths[1]);
+        assignColumn(character.surname, row[2], lengths[2]);
+        character.age = static_cast<uint8_t>(std::stoi(row[3]));
+        assignColumn(character.bio, row[4], lengths[4]);
+
+        character.appendTo(chunk);
+        ++count;
+
+        if (chunk.size() >= chunkSize) {
+            if (!finishChunk()) {
+                completed = false;
+                break;
+            }
+            startChunk();
+        }
+    }
+
+    if (completed && mysql_errno(connection.get()) != 0) {
+        // Fetch stopped because of an error, not the end of the result
+        connection.checkError();
+        completed = false;
+    } else if (completed && count > 0) {
+        completed = finishChunk();
+    }
+
+    // Also discards rows left unread when the sink stopped the stream
+    mysql_free_result(result);
+    return completed;
+}
+
 std::optional<CharacterData> DatabaseManager::getCharacter(int id) {
-    std::lock_guard<std::mutex> lock(m_dbMutex);
-    std::string query = "SELECT id, name, surname, age, bio FROM characters WHERE id = ?";
-    MYSQL_STMT* stmt = mysql_stmt_init(m_connection);
+    if (auto cached = m_cache.get(id)) {
+        return cached;
+    }
+
+    // Taken before the query, so a concurrent update invalidates what we load
+    uint64_t token = m_cache.beginLoad(id);
+
+    auto connection = m_pool.acquire();
+    if (!connection) return std::nullopt;
+
+    auto& statements = connection.statements();
+    StatementCache::bindValue(statements.params(StatementCache::SELECT_CHARACTER)[0], id);
+
+    MYSQL_STMT* stmt = execute(connection, StatementCache::SELECT_CHARACTER);
     if (!stmt) {
         return std::nullopt;
     }
 
-    if (mysql_stmt_prepare(stmt, query.c_str(), query.length()) != 0) {
-        mysql_stmt_close(stmt);
+    CharacterData character;
+    bool found = statements.fetchCharacter(stmt, character);
+    mysql_stmt_free_result(stmt);
+
+    if (!found) {
         return std::nullopt;
     }
 
-    // Bind input parameter
-    MYSQL_BIND bind{};
-    bind.buffer_type = MYSQL_TYPE_LONG;
-    bind.buffer = &id;
-    bind.is_unsigned = false;
+    m_cache.fill(character, token);
+    return character;
+}
 
-    if (mysql_stmt_bind_param(stmt, &bind) != 0) {
-        mysql_stmt_close(stmt);
-        return std::nullopt;
+bool DatabaseManager::tryGetCharacter(int id, std::optional<CharacterData>& character) {
+    // A miss is counted by the getCharacter() that follows
+    character = m_cache.get(id, false);
+    return character.has_value();
+}
+
+std::vector<std::optional<CharacterData>> DatabaseManager::getCharacters(const std::vector<int32_t>& ids) {
+    std::vector<std::optional<CharacterData>> characters(ids.size());
+
+    // Cache misses by id, with the positions they fill and their load token
+    struct Pending {
+        uint64_t token = 0;
+        std::vector<size_t> positions;
+    };
+    std::unordered_map<int32_t, Pending> pending;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (auto cached = m_cache.get(ids[i])) {
+            characters[i] = std::move(cached);
+        } else {
+            pending[ids[i]].positions.push_back(i);
+        }
     }
+    if (pending.empty()) return characters;
 
-    if (mysql_stmt_execute(stmt) != 0) {
-        mysql_stmt_close(stmt);
-        return std::nullopt;
+    // Taken before the query, so a concurrent update invalidates what we load
+    for (auto& entry : pending) {
+        entry.second.token = m_cache.beginLoad(entry.first);
     }
 
-    // Setup result bindings
-    CharacterData character;
-    my_bool is_null[5] = {0};
-    my_bool error[5] = {0};
-
-    MYSQL_BIND result_bind[5]{};
-
-    // ID
-    result_bind[0].buffer_type = MYSQL_TYPE_LONG;
-    result_bind[0].buffer = &character.id;
-    result_bind[0].is_null = &is_null[0];
-    result_bind[0].error = &error[0];
-
-    // Name
-    char name_buffer[51] = {0};
-    result_bind[1].buffer_type = MYSQL_TYPE_STRING;
-    result_bind[1].buffer = name_buffer;
-    result_bind[1].buffer_length = sizeof(name_buffer);
-    result_bind[1].is_null = &is_null[1];
-    result_bind[1].error = &error[1];
-
-    // Surname
-    char surname_buffer[51] = {0};
-    result_bind[2].buffer_type = MYSQL_TYPE_STRING;
-    result_bind[2].buffer = surname_buffer;
-    result_bind[2].buffer_length = sizeof(surname_buffer);
-    result_bind[2].is_null = &is_null[2];
-    result_bind[2].error = &error[2];
-
-    // Age
-    result_bind[3].buffer_type = MYSQL_TYPE_LONG;
-    result_bind[3].buffer = &character.age;
-    result_bind[3].is_null = &is_null[3];
-    result_bind[3].error = &error[3];
-
-    // Bio
-    char bio_buffer[4096] = {0};
-    result_bind[4].buffer_type = MYSQL_TYPE_STRING;
-    result_bind[4].buffer = bio_buffer;
-    result_bind[4].buffer_length = sizeof(bio_buffer);
-    result_bind[4].is_null = &is_null[4];
-    result_bind[4].error = &error[4];
-
-    if (mysql_stmt_bind_result(stmt, result_bind) != 0) {
-        mysql_stmt_close(stmt);
-        return std::nullopt;
+    auto connection = m_pool.acquire();
+    if (!connection) return characters;
+
+    // Ids are integers, so they are safe to write into the query text
+    std::string query = "SELECT id, name, surname, age, bio FROM characters WHERE id IN (";
+    bool first = true;
+    for (const auto& entry : pending) {
+        if (!first) query += ',';
+        query += std::to_string(entry.first);
+        first = false;
     }
+    query += ')';
 
-    // Fetch results
-    if (mysql_stmt_fetch(stmt) != 0) {
-        mysql_stmt_close(stmt);
-        return std::nullopt;
+    if (mysql_real_query(connection.get(), query.data(), query.size()) != 0) {
+        connection.checkError();
+        return characters;
     }
 
-    // Copy string data
-    character.name = name_buffer;
-    character.surname = surname_buffer;
-    character.bio = bio_buffer;
+    MYSQL_RES* result = mysql_store_result(connection.get());
+    if (!result) {
+        connection.checkError();
+        return characters;
+    }
 
-    mysql_stmt_close(stmt);
-    return character;
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        unsigned long* lengths = mysql_fetch_lengths(result);
+        CharacterData character;
+        character.id = std::stoi(row[0]);
+        character.name.assign(row[1] ? row[1] : "", row[1] ? lengths[1] : 0);
+        character.surname.assign(row[2] ? row[2] : "", row[2] ? lengths[2] : 0);
+        character.age = static_cast<uint8_t>(std::stoi(row[3]));
+        character.bio.assign(row[4] ? row[4] : "", row[4] ? lengths[4] : 0);
+
+        auto it = pending.find(character.id);
+        if (it == pending.end()) continue;
+        m_cache.fill(character, it->second.token);
+        for (size_t position : it->second.positions) {
+            characters[position] = character;
+        }
+    }
+
+    mysql_free_result(result);
+    return characters;
+}
+
+std::vector<CharacterData> DatabaseManager::getCharacterRange(std::optional<int32_t> afterId,
+                                                             size_t limit, bool descending) {
+    std::vector<CharacterData> characters;
+    // An empty page means the end of the table, so a failed query has to be an error
+    if (!selectRange(afterId, limit, descending, characters)) {
+        throw std::runtime_error("Failed to read a range of characters");
+    }
+    return characters;
+}
+
+bool DatabaseManager::readStreamPage(std::optional<int32_t> afterId, size_t limit,
+                                     std::vector<CharacterData>& page) {
+    // A failed query must not look like the end of the table
+    return selectRange(afterId, limit, false, page);
+}
+
+bool DatabaseManager::selectRange(std::optional<int32_t> afterId, size_t limit, bool descending,
+                                  std::vector<CharacterData>& characters) {
+    if (limit == 0) return true;
+
+    auto connection = m_pool.acquire();
+    if (!connection) return false;
+
+    // Bound as 64 bit, so the default cursor lies past every INT id
+    int64_t cursor = afterId ? *afterId
+                             : (descending ? int64_t(INT32_MAX) + 1 : int64_t(INT32_MIN) - 1);
+    int64_t rows = static_cast<int64_t>(limit);
+
+    StatementCache::Id statement = descending ? StatementCache::SELECT_RANGE_DESC
+                                              : StatementCache::SELECT_RANGE_ASC;
+    auto& statements = connection.statements();
+    MYSQL_BIND* bind = statements.params(statement);
+    StatementCache::bindValue(bind[0], cursor);
+    StatementCache::bindValue(bind[1], rows);
+
+    MYSQL_STMT* stmt = execute(connection, statement);
+    if (!stmt) {
+        return false;
+    }
+
+    characters.reserve(limit);
+    CharacterData character;
+    while (statements.fetchCharacter(stmt, character)) {
+        characters.push_back(std::move(character));
+    }
+    bool completed = mysql_stmt_errno(stmt) == 0;
+    if (!completed) {
+        connection.checkError(stmt);
+    }
+    mysql_stmt_free_result(stmt);
+    return completed;
+}
+
+MYSQL_STMT* DatabaseManager::execute(ConnectionPool::Handle& connection, StatementCache::Id id) {
+    auto& statements = connection.statements();
+    MYSQL_STMT* stmt = statements.get(id);
+    if (!stmt) {
+        connection.checkError();
+        return nullptr;
+    }
+
+    if (mysql_stmt_bind_param(stmt, statements.params(id)) != 0 ||
+            mysql_stmt_execute(stmt) != 0) {
+        connection.checkError(stmt);
+        return nullptr;
+    }
+    return stmt;
 }
 
 bool DatabaseManager::executeQuery(const std::string& query) {
-    return mysql_query(m_connection, query.c_str()) == 0;
+    auto connection = m_pool.acquire();
+    if (!connection) return false;
+
+    if (mysql_query(connection.get(), query.c_str()) != 0) {
+        connection.checkError();
+        return false;
+    }
+    return true;
 }
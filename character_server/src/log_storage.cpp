@@ -0,0 +1,725 @@
+#include "log_storage.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t FILE_MAGIC = 0x474C5343; ///< "CSLG"
+constexpr uint32_t FILE_VERSION = 1; ///< Log format version
+// magic, version, next id
+constexpr size_t FILE_HEADER_SIZE = sizeof(uint32_t) * 2 + sizeof(int32_t);
+// payload size, checksum, type
+constexpr size_t RECORD_HEADER_SIZE = sizeof(uint32_t) * 2 + sizeof(uint8_t);
+// Anything larger is treated as a torn header during recovery
+constexpr uint32_t MAX_RECORD_PAYLOAD = 64 * 1024 * 1024;
+
+// pwrite that retries short writes
+bool writeAll(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = ::pwrite(fd, data + written, size - written, static_cast<off_t>(offset + written));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// pread that retries short reads, fails at end of file
+bool readAll(int fd, uint8_t* data, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::pread(fd, data + done, size - done, static_cast<off_t>(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Makes a rename inside the directory durable
+void syncDirectory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+}
+
+LogStorage::LogStorage(const std::string& directory)
+    : m_directory(directory),
+      m_path((std::filesystem::path(directory) / LOG_FILE_NAME).string())
+{
+
+}
+
+LogStorage::~LogStorage() {
+    {
+        std::lock_guard<std::mutex> lock(m_syncMutex);
+        m_stopping = true;
+    }
+    m_syncRequested.notify_all();
+    m_compactionWakeup.notify_all();
+
+    if (m_compactionThread.joinable()) {
+        m_compactionThread.join();
+    }
+    if (m_flushThread.joinable()) {
+        m_flushThread.join();
+    }
+
+    if (m_fd >= 0) {
+        ::fdatasync(m_fd);
+        ::close(m_fd);
+    }
+}
+
+bool LogStorage::open() {
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory, ec);
+    if (ec) {
+        std::cerr << "Cannot create data directory " << m_directory << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    // Left over by a compaction that did not finish
+    std::filesystem::remove(m_path + ".compact", ec);
+
+    m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        std::cerr << "Cannot open " << m_path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (!recover()) {
+        return false;
+    }
+
+    m_flushThread = std::thread([this]() { flushLoop(); });
+    m_compactionThread = std::thread([this]() { compactionLoop(); });
+    return true;
+}
+
+bool LogStorage::addCharacter(const CharacterData& character) {
+    std::vector<uint8_t> records;
+    uint64_t lsn = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (!idsAvailable(1)) return false;
+
+        CharacterData stored = character;
+        stored.id = static_cast<int32_t>(m_nextId);
+
+        auto payload = stored.serialize();
+        Location location{m_fileSize, encodeRecord(records, RECORD_PUT, payload.data(),
+                                                   static_cast<uint32_t>(payload.size()))};
+        if (!append(records, lsn)) return false;
+        ++m_nextId;
+        setLocation(stored.id, location);
+    }
+    return waitDurable(lsn);
+}
+
+std::optional<std::vector<int32_t>> LogStorage::addCharacters(const std::vector<CharacterData>& characters) {
+    std::vector<int32_t> ids;
+    ids.reserve(characters.size());
+
+    std::vector<uint8_t> records;
+    std::vector<Location> locations;
+    locations.reserve(characters.size());
+    uint64_t lsn = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (!idsAvailable(characters.size())) return std::nullopt;
+
+        uint64_t offset = m_fileSize;
+        int32_t firstId = static_cast<int32_t>(m_nextId);
+
+        // One write and one fsync for the whole batch
+        for (const auto& character : characters) {
+            CharacterData stored = character;
+            stored.id = firstId + static_cast<int32_t>(ids.size());
+
+            auto payload = stored.serialize();
+            uint32_t size = encodeRecord(records, RECORD_PUT, payload.data(),
+                                         static_cast<uint32_t>(payload.size()));
+            locations.push_back({offset, size});
+            offset += size;
+            ids.push_back(stored.id);
+        }
+
+        if (!append(records, lsn)) return std::nullopt;
+
+        m_nextId += static_cast<int64_t>(ids.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            setLocation(ids[i], locations[i]);
+        }
+    }
+
+    if (!waitDurable(lsn)) return std::nullopt;
+    return ids;
+}
+
+bool LogStorage::updateCharacter(int id, const CharacterData& character) {
+    std::vector<uint8_t> records;
+    uint64_t lsn = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+        // Like an UPDATE matching no row, a missing id is not an error
+        if (m_index.find(id) == m_index.end()) return true;
+
+        CharacterData stored = character;
+        stored.id = id;
+
+        auto payload = stored.serialize();
+        Location location{m_fileSize, encodeRecord(records, RECORD_PUT, payload.data(),
+                                                   static_cast<uint32_t>(payload.size()))};
+        if (!append(records, lsn)) return false;
+        setLocation(id, location);
+    }
+    return waitDurable(lsn);
+}
+
+bool LogStorage::deleteCharacter(int id) {
+    std::vector<uint8_t> records;
+    uint64_t lsn = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+        auto it = m_index.find(id);
+        if (it == m_index.end()) return true;
+
+        int32_t deletedId = id;
+        encodeRecord(records, RECORD_DELETE, reinterpret_cast<const uint8_t*>(&deletedId),
+                     sizeof(deletedId));
+        if (!append(records, lsn)) return false;
+
+        eraseLocation(it);
+    }
+    return waitDurable(lsn);
+}
+
+std::vector<CharacterData> LogStorage::getAllCharacters() {
+    int fd = -1;
+    auto locations = snapshotLocations(fd);
+
+    std::vector<CharacterData> characters;
+    characters.reserve(locations.size());
+    for (const auto& location : locations) {
+        if (auto character = readCharacter(fd, location)) {
+            characters.push_back(std::move(*character));
+        }
+    }
+    ::close(fd);
+
+    // Same order as the primary key scan of the MySQL backend
+    std::sort(characters.begin(), characters.end(),
+              [](const CharacterData& a, const CharacterData& b) { return a.id < b.id; });
+    return characters;
+}
+
+bool LogStorage::streamAllCharacters(size_t chunkSize, const ChunkSink& sink) {
+    int fd = -1;
+    auto locations = snapshotLocations(fd);
+
+    std::vector<uint8_t> chunk;
+    uint32_t count = 0;
+    auto startChunk = [&]() {
+        chunk.clear();
+        chunk.reserve(chunkSize + chunkSize / 4);
+        count = 0;
+        chunk.resize(sizeof(count));
+    };
+    auto finishChunk = [&]() {
+        std::memcpy(chunk.data(), &count, sizeof(count));
+        return sink(std::move(chunk));
+    };
+
+    bool completed = true;
+    startChunk();
+    for (const auto& location : locations) {
+        auto character = readCharacter(fd, location);
+        if (!character) continue;
+
+        character->appendTo(chunk);
+        ++count;
+
+        if (chunk.size() >= chunkSize) {
+            if (!finishChunk()) {
+                completed = false;
+                break;
+            }
+            startChunk();
+        }
+    }
+
+    if (completed && count > 0) {
+        completed = finishChunk();
+    }
+
+    ::close(fd);
+    return completed;
+}
+
+std::optional<CharacterData> LogStorage::getCharacter(int id) {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    auto it = m_index.find(id);
+    if (it == m_index.end()) {
+        return std::nullopt;
+    }
+    return readCharacter(m_fd, it->second);
+}
+
+std::vector<CharacterData> LogStorage::getCharacterRange(std::optional<int32_t> afterId,
+                                                        size_t limit, bool descending) {
+    std::vector<CharacterData> characters;
+    if (limit == 0) return characters;
+
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+    // The ordered ids locate the page, only its records are read from disk
+    auto read = [this, &characters](int32_t id) {
+        if (auto character = readCharacter(m_fd, m_index.find(id)->second)) {
+            characters.push_back(std::move(*character));
+        }
+    };
+    if (descending) {
+        auto it = afterId ? m_order.lower_bound(*afterId) : m_order.end();
+        while (it != m_order.begin() && characters.size() < limit) {
+            read(*--it);
+        }
+    } else {
+        auto it = afterId ? m_order.upper_bound(*afterId) : m_order.begin();
+        for (; it != m_order.end() && characters.size() < limit; ++it) {
+            read(*it);
+        }
+    }
+    return characters;
+}
+
+bool LogStorage::compact() {
+    std::lock_guard<std::mutex> compactionLock(m_compactionMutex);
+
+    // Copy the live records without blocking writers
+    int sourceFd = -1;
+    uint64_t snapshotEnd = 0;
+    std::vector<std::pair<int32_t, Location>> live;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        live.assign(m_index.begin(), m_index.end());
+        snapshotEnd = m_fileSize;
+        sourceFd = ::dup(m_fd);
+    }
+    if (sourceFd < 0) return false;
+
+    std::sort(live.begin(), live.end(),
+              [](const auto& a, const auto& b) { return a.second.offset < b.second.offset; });
+
+    std::string compactPath = m_path + ".compact";
+    int targetFd = ::open(compactPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (targetFd < 0) {
+        ::close(sourceFd);
+        return false;
+    }
+
+    auto fail = [&]() {
+        ::close(sourceFd);
+        ::close(targetFd);
+        std::error_code ec;
+        std::filesystem::remove(compactPath, ec);
+        return false;
+    };
+
+    std::unordered_map<int32_t, Location> index;
+    index.reserve(live.size());
+    uint64_t targetSize = FILE_HEADER_SIZE;
+    uint64_t liveBytes = 0;
+    std::vector<uint8_t> record;
+
+    for (const auto& entry : live) {
+        record.resize(entry.second.size);
+        if (!readAll(sourceFd, record.data(), record.size(), entry.second.offset) ||
+                !writeAll(targetFd, record.data(), record.size(), targetSize)) {
+            return fail();
+        }
+        index[entry.first] = {targetSize, entry.second.size};
+        targetSize += entry.second.size;
+        liveBytes += entry.second.size;
+    }
+
+    // The copy is synced before anyone waits, under the lock only the
+    // catch-up tail and the header are left to flush
+    if (::fdatasync(targetFd) != 0) {
+        return fail();
+    }
+
+    // Catch up with records appended meanwhile, readers and writers wait from here on
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    uint64_t offset = snapshotEnd;
+    while (offset < m_fileSize) {
+        uint8_t header[RECORD_HEADER_SIZE];
+        if (!readAll(m_fd, header, sizeof(header), offset)) return fail();
+
+        uint32_t payloadSize = 0;
+        std::memcpy(&payloadSize, header, sizeof(payloadSize));
+        uint32_t size = static_cast<uint32_t>(RECORD_HEADER_SIZE + payloadSize);
+
+        record.resize(size);
+        if (!readAll(m_fd, record.data(), size, offset) ||
+                !writeAll(targetFd, record.data(), size, targetSize)) {
+            return fail();
+        }
+
+        int32_t id = 0;
+        std::memcpy(&id, record.data() + RECORD_HEADER_SIZE, sizeof(id));
+        auto it = index.find(id);
+        if (it != index.end()) {
+            liveBytes -= it->second.size;
+            index.erase(it);
+        }
+        if (header[RECORD_HEADER_SIZE - 1] == RECORD_PUT) {
+            index[id] = {targetSize, size};
+            liveBytes += size;
+        }
+
+        targetSize += size;
+        offset += size;
+    }
+
+    // The header keeps the id counter, the record of the highest id may be gone
+    if (!writeHeader(targetFd, m_nextId) || ::fdatasync(targetFd) != 0) {
+        return fail();
+    }
+    if (std::rename(compactPath.c_str(), m_path.c_str()) != 0) {
+        return fail();
+    }
+    syncDirectory(m_directory);
+
+    uint64_t before = m_fileSize;
+    ::close(sourceFd);
+    ::close(m_fd);
+    m_fd = targetFd;
+    m_fileSize = targetSize;
+    m_liveBytes = liveBytes;
+    // Same ids as before, only their locations moved, so m_order stays valid
+    m_index = std::move(index);
+
+    // Everything appended so far is in the synced new file
+    {
+        std::lock_guard<std::mutex> syncLock(m_syncMutex);
+        m_durableLsn = std::max(m_durableLsn, m_appendedBytes);
+    }
+    m_synced.notify_all();
+
+    std::cout << "Compacted " << m_path << " from " << before << " to "
+              << targetSize << " bytes" << std::endl;
+    return true;
+}
+
+uint32_t LogStorage::encodeRecord(std::vector<uint8_t>& buffer, RecordType type,
+                                  const uint8_t* payload, uint32_t size) {
+    uint32_t sum = checksum(type, payload, size);
+    uint8_t typeByte = type;
+
+    size_t offset = buffer.size();
+    buffer.resize(offset + RECORD_HEADER_SIZE + size);
+    std::memcpy(buffer.data() + offset, &size, sizeof(size));
+    std::memcpy(buffer.data() + offset + sizeof(size), &sum, sizeof(sum));
+    std::memcpy(buffer.data() + offset + sizeof(size) + sizeof(sum), &typeByte, sizeof(typeByte));
+    std::memcpy(buffer.data() + offset + RECORD_HEADER_SIZE, payload, size);
+
+    return static_cast<uint32_t>(RECORD_HEADER_SIZE + size);
+}
+
+uint32_t LogStorage::checksum(RecordType type, const uint8_t* payload, uint32_t size) {
+    // FNV-1a, enough to detect torn and garbage tails
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ static_cast<uint8_t>(type)) * 16777619u;
+    for (uint32_t i = 0; i < size; ++i) {
+        hash = (hash ^ payload[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool LogStorage::idsAvailable(size_t count) {
+    if (m_nextId + static_cast<int64_t>(count) - 1 > std::numeric_limits<int32_t>::max()) {
+        std::cerr << "Character ids exhausted, rejecting inserts" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool LogStorage::append(const std::vector<uint8_t>& records, uint64_t& lsn) {
+    // Once a sync failed nothing written after it can be made durable, so
+    // the write is refused before it reaches the file or the index
+    {
+        std::lock_guard<std::mutex> syncLock(m_syncMutex);
+        if (m_syncFailed) return false;
+    }
+
+    // A failed write is overwritten by the next append at the same offset
+    if (!writeAll(m_fd, records.data(), records.size(), m_fileSize)) {
+        std::cerr << "Log write failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    m_fileSize += records.size();
+    m_appendedBytes += records.size();
+    lsn = m_appendedBytes;
+    return true;
+}
+
+bool LogStorage::waitDurable(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(m_syncMutex);
+    if (m_durableLsn >= lsn) return true;
+
+    m_requestedLsn = std::max(m_requestedLsn, lsn);
+    m_syncRequested.notify_one();
+    m_synced.wait(lock, [this, lsn]() { return m_durableLsn >= lsn || m_syncFailed; });
+    return m_durableLsn >= lsn;
+}
+
+void LogStorage::setLocation(int32_t id, const Location& location) {
+    auto [it, inserted] = m_index.try_emplace(id);
+    if (inserted) {
+        // Ids mostly grow, the end hint makes their insert constant time
+        m_order.insert(m_order.end(), id);
+    }
+    m_liveBytes -= it->second.size;
+    m_liveBytes += location.size;
+    it->second = location;
+}
+
+void LogStorage::eraseLocation(std::unordered_map<int32_t, Location>::iterator it) {
+    m_liveBytes -= it->second.size;
+    m_order.erase(it->first);
+    m_index.erase(it);
+}
+
+std::optional<CharacterData> LogStorage::readCharacter(int fd, const Location& location) {
+    std::vector<uint8_t> record(location.size);
+    if (location.size < RECORD_HEADER_SIZE ||
+            !readAll(fd, record.data(), record.size(), location.offset)) {
+        return std::nullopt;
+    }
+
+    uint32_t payloadSize = 0;
+    uint32_t sum = 0;
+    std::memcpy(&payloadSize, record.data(), sizeof(payloadSize));
+    std::memcpy(&sum, record.data() + sizeof(payloadSize), sizeof(sum));
+    auto type = static_cast<RecordType>(record[RECORD_HEADER_SIZE - 1]);
+    const uint8_t* payload = record.data() + RECORD_HEADER_SIZE;
+
+    if (type != RECORD_PUT || RECORD_HEADER_SIZE + payloadSize != location.size ||
+            checksum(type, payload, payloadSize) != sum) {
+        std::cerr << "Corrupt log record at offset " << location.offset << std::endl;
+        return std::nullopt;
+    }
+
+    return CharacterData::deserialize(std::vector<uint8_t>(payload, payload + payloadSize));
+}
+
+std::vector<LogStorage::Location> LogStorage::snapshotLocations(int& fd) const {
+    std::vector<Location> locations;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        locations.reserve(m_index.size());
+        for (const auto& entry : m_index) {
+            locations.push_back(entry.second);
+        }
+        // Stays valid even if a compaction replaces the file meanwhile
+        fd = ::dup(m_fd);
+    }
+
+    // Read in file order
+    std::sort(locations.begin(), locations.end(),
+              [](const Location& a, const Location& b) { return a.offset < b.offset; });
+    return locations;
+}
+
+bool LogStorage::recover() {
+    struct stat info{};
+    if (::fstat(m_fd, &info) != 0) return false;
+    uint64_t size = static_cast<uint64_t>(info.st_size);
+
+    if (size < FILE_HEADER_SIZE) {
+        // New (or never completely initialized) log
+        if (::ftruncate(m_fd, 0) != 0 || !writeHeader(m_fd, 1) || ::fdatasync(m_fd) != 0) {
+            return false;
+        }
+        m_fileSize = FILE_HEADER_SIZE;
+        return true;
+    }
+
+    uint8_t header[FILE_HEADER_SIZE];
+    if (!readAll(m_fd, header, sizeof(header), 0)) return false;
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    int32_t headerNextId = 1;
+    std::memcpy(&magic, header, sizeof(magic));
+    std::memcpy(&version, header + sizeof(magic), sizeof(version));
+    std::memcpy(&headerNextId, header + sizeof(magic) + sizeof(version), sizeof(headerNextId));
+    if (magic != FILE_MAGIC || version != FILE_VERSION) {
+        std::cerr << m_path << " is not a character log" << std::endl;
+        return false;
+    }
+    m_nextId = headerNextId;
+
+    // Replay through a read window instead of two syscalls per record
+    constexpr size_t WINDOW_SIZE = 1024 * 1024;
+    std::vector<uint8_t> window;
+    uint64_t windowStart = 0;
+    auto view = [&](uint64_t offset, size_t length) -> const uint8_t* {
+        if (offset < windowStart || offset + length > windowStart + window.size()) {
+            size_t available = static_cast<size_t>(std::min<uint64_t>(std::max(WINDOW_SIZE, length),
+                                                                      size - offset));
+            if (available < length) return nullptr;
+            window.resize(available);
+            if (!readAll(m_fd, window.data(), available, offset)) return nullptr;
+            windowStart = offset;
+        }
+        return window.data() + (offset - windowStart);
+    };
+
+    uint64_t offset = FILE_HEADER_SIZE;
+    size_t records = 0;
+    while (offset < size) {
+        const uint8_t* recordHeader = view(offset, RECORD_HEADER_SIZE);
+        if (!recordHeader) break;
+
+        uint32_t payloadSize = 0;
+        uint32_t sum = 0;
+        std::memcpy(&payloadSize, recordHeader, sizeof(payloadSize));
+        std::memcpy(&sum, recordHeader + sizeof(payloadSize), sizeof(sum));
+        auto type = static_cast<RecordType>(recordHeader[RECORD_HEADER_SIZE - 1]);
+        if (payloadSize < sizeof(int32_t) || payloadSize > MAX_RECORD_PAYLOAD ||
+                (type != RECORD_PUT && type != RECORD_DELETE)) {
+            break;
+        }
+
+        uint32_t recordSize = static_cast<uint32_t>(RECORD_HEADER_SIZE + payloadSize);
+        const uint8_t* record = view(offset, recordSize);
+        if (!record || checksum(type, record + RECORD_HEADER_SIZE, payloadSize) != sum) {
+            break;
+        }
+
+        // Both record types start with the id
+        int32_t id = 0;
+        std::memcpy(&id, record + RECORD_HEADER_SIZE, sizeof(id));
+        if (type == RECORD_PUT) {
+            setLocation(id, {offset, recordSize});
+            m_nextId = std::max(m_nextId, static_cast<int64_t>(id) + 1);
+        } else {
+            auto it = m_index.find(id);
+            if (it != m_index.end()) {
+                eraseLocation(it);
+            }
+        }
+
+        offset += recordSize;
+        ++records;
+    }
+
+    if (offset < size) {
+        std::cerr << "Truncating torn log tail of " << (size - offset) << " bytes at offset "
+                  << offset << std::endl;
+        if (::ftruncate(m_fd, static_cast<off_t>(offset)) != 0 || ::fdatasync(m_fd) != 0) {
+            return false;
+        }
+    }
+
+    m_fileSize = offset;
+    std::cout << "Replayed " << records << " log records, " << m_index.size()
+              << " characters" << std::endl;
+    return true;
+}
+
+bool LogStorage::writeHeader(int fd, int64_t nextId) {
+    // Past the last id the header keeps INT32_MAX, replay of its record raises it again
+    int32_t storedNextId = static_cast<int32_t>(
+            std::min<int64_t>(nextId, std::numeric_limits<int32_t>::max()));
+
+    uint8_t header[FILE_HEADER_SIZE];
+    std::memcpy(header, &FILE_MAGIC, sizeof(FILE_MAGIC));
+    std::memcpy(header + sizeof(FILE_MAGIC), &FILE_VERSION, sizeof(FILE_VERSION));
+    std::memcpy(header + sizeof(FILE_MAGIC) + sizeof(FILE_VERSION), &storedNextId, sizeof(storedNextId));
+    return writeAll(fd, header, sizeof(header), 0);
+}
+
+void LogStorage::flushLoop() {
+    std::unique_lock<std::mutex> lock(m_syncMutex);
+    while (true) {
+        m_syncRequested.wait(lock, [this]() {
+            return m_stopping || (!m_syncFailed && m_requestedLsn > m_durableLsn);
+        });
+        // On shutdown, still serve writers that are already waiting
+        if (m_syncFailed || m_requestedLsn <= m_durableLsn) break;
+
+        // Everything requested so far is covered by this one sync
+        uint64_t target = m_requestedLsn;
+        lock.unlock();
+
+        int fd = -1;
+        {
+            std::shared_lock<std::shared_mutex> fileLock(m_mutex);
+            fd = ::dup(m_fd);
+        }
+        bool synced = fd >= 0 && ::fdatasync(fd) == 0;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+
+        lock.lock();
+        if (synced) {
+            m_durableLsn = std::max(m_durableLsn, target);
+        } else {
+            std::cerr << "Log fsync failed, rejecting further writes" << std::endl;
+            m_syncFailed = true;
+        }
+        m_synced.notify_all();
+    }
+
+    m_synced.notify_all();
+}
+
+void LogStorage::compactionLoop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_syncMutex);
+            if (m_compactionWakeup.wait_for(lock, COMPACTION_INTERVAL, [this]() { return m_stopping; })) {
+                return;
+            }
+        }
+
+        bool worthIt = false;
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            // Compact once superseded records make up more than half of the log
+            worthIt = m_fileSize >= COMPACTION_MIN_BYTES && m_liveBytes < m_fileSize / 2;
+        }
+
+        if (worthIt && !compact()) {
+            std::cerr << "Log compaction failed" << std::endl;
+        }
+    }
+}
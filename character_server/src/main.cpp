@@ -1,24 +1,21 @@
 #include "server_instance.h"
-#include <csignal>
 #include <iostream>
+#include <stdexcept>
 
-std::function<void(int)> shutdownHandler;
-void signalHandler(int signal) { shutdownHandler(signal); }
+int main(int argc, char* argv[]) {
+    ServerConfig config;
+    try {
+        config = ServerConfig::fromCommandLine(argc, argv);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << "\n" << ServerConfig::usage();
+        return 1;
+    }
 
-int main() {
     try {
         auto& server = ServerInstance::getInstance();
 
-        // Setup signal handling
-        shutdownHandler = [&](int signal) {
-            std::cout << "\nShutting down server..." << std::endl;
-            server.stop();
-        };
-
-        std::signal(SIGINT, signalHandler);
-        std::signal(SIGTERM, signalHandler);
-
-        if (!server.initialize(Protocol::PORT)) {
+        // SIGINT and SIGTERM are handled by run() on an I/O thread
+        if (!server.initialize(config)) {
             std::cerr << "Failed to initialize server" << std::endl;
             return 1;
         }
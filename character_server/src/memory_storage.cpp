@@ -0,0 +1,199 @@
+#include "memory_storage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+MemoryStorage::MemoryStorage(size_t stripeCount) {
+    if (stripeCount == 0) {
+        stripeCount = 1;
+    }
+
+    m_stripes.reserve(stripeCount);
+    for (size_t i = 0; i < stripeCount; ++i) {
+        m_stripes.push_back(std::make_unique<Stripe>());
+    }
+}
+
+bool MemoryStorage::addCharacter(const CharacterData& character) {
+    CharacterData stored = character;
+    stored.id = m_nextId++;
+
+    int32_t id = stored.id;
+
+    // The order lock spans the stripe update, so a delete of the id cannot
+    // slip in between and leave it in m_order
+    std::unique_lock<std::shared_mutex> orderLock(m_orderMutex);
+    {
+        Stripe& stripe = stripeFor(id);
+        std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+        stripe.characters[id] = std::move(stored);
+    }
+    m_order.insert(m_order.end(), id);
+    return true;
+}
+
+std::optional<std::vector<int32_t>> MemoryStorage::addCharacters(const std::vector<CharacterData>& characters) {
+    std::vector<int32_t> ids;
+    ids.reserve(characters.size());
+
+    // Reserve a contiguous id range, like a multi-row INSERT
+    int32_t firstId = m_nextId.fetch_add(static_cast<int32_t>(characters.size()));
+
+    std::unique_lock<std::shared_mutex> orderLock(m_orderMutex);
+    for (size_t i = 0; i < characters.size(); ++i) {
+        CharacterData stored = characters[i];
+        stored.id = firstId + static_cast<int32_t>(i);
+        ids.push_back(stored.id);
+        {
+            Stripe& stripe = stripeFor(stored.id);
+            std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+            stripe.characters[stored.id] = std::move(stored);
+        }
+        // New ids are the highest so far, the end hint makes the insert constant time
+        m_order.insert(m_order.end(), ids.back());
+    }
+    return ids;
+}
+
+bool MemoryStorage::updateCharacter(int id, const CharacterData& character) {
+    Stripe& stripe = stripeFor(id);
+    std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+
+    // Like an UPDATE matching no row, a missing id is not an error
+    auto it = stripe.characters.find(id);
+    if (it != stripe.characters.end()) {
+        it->second = character;
+        it->second.id = id;
+    }
+    return true;
+}
+
+bool MemoryStorage::deleteCharacter(int id) {
+    std::unique_lock<std::shared_mutex> orderLock(m_orderMutex);
+    {
+        Stripe& stripe = stripeFor(id);
+        std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+        stripe.characters.erase(id);
+    }
+    m_order.erase(id);
+    return true;
+}
+
+std::vector<CharacterData> MemoryStorage::getAllCharacters() {
+    std::vector<CharacterData> characters;
+    for (const auto& stripe : m_stripes) {
+        std::shared_lock<std::shared_mutex> lock(stripe->mutex);
+        for (const auto& entry : stripe->characters) {
+            characters.push_back(entry.second);
+        }
+    }
+
+    // Same order as the primary key scan of the MySQL backend
+    std::sort(characters.begin(), characters.end(),
+              [](const CharacterData& a, const CharacterData& b) { return a.id < b.id; });
+    return characters;
+}
+
+bool MemoryStorage::streamAllCharacters(size_t chunkSize, const ChunkSink& sink) {
+    std::vector<uint8_t> chunk;
+    uint32_t count = 0;
+    auto startChunk = [&]() {
+        chunk.clear();
+        chunk.reserve(chunkSize + chunkSize / 4);
+        count = 0;
+        chunk.resize(sizeof(count));
+    };
+    auto finishChunk = [&]() {
+        std::memcpy(chunk.data(), &count, sizeof(count));
+        return sink(std::move(chunk));
+    };
+
+    startChunk();
+    std::vector<CharacterData> characters;
+    for (const auto& stripe : m_stripes) {
+        // Copy the stripe out, the sink may block on the network
+        {
+            std::shared_lock<std::shared_mutex> lock(stripe->mutex);
+            characters.clear();
+            characters.reserve(stripe->characters.size());
+            for (const auto& entry : stripe->characters) {
+                characters.push_back(entry.second);
+            }
+        }
+
+        for (const auto& character : characters) {
+            character.appendTo(chunk);
+            ++count;
+
+            if (chunk.size() >= chunkSize) {
+                if (!finishChunk()) return false;
+                startChunk();
+            }
+        }
+    }
+
+    if (count > 0) {
+        return finishChunk();
+    }
+    return true;
+}
+
+std::optional<CharacterData> MemoryStorage::getCharacter(int id) {
+    Stripe& stripe = stripeFor(id);
+    std::shared_lock<std::shared_mutex> lock(stripe.mutex);
+
+    auto it = stripe.characters.find(id);
+    if (it == stripe.characters.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+bool MemoryStorage::tryGetCharacter(int id, std::optional<CharacterData>& character) {
+    // Only a stripe lock is taken, nothing waits for I/O
+    character = getCharacter(id);
+    return true;
+}
+
+std::vector<CharacterData> MemoryStorage::getCharacterRange(std::optional<int32_t> afterId,
+                                                           size_t limit, bool descending) {
+    std::vector<CharacterData> page;
+    if (limit == 0) return page;
+
+    // Ids come from the ordered set, the characters from their stripes. An id
+    // deleted in between is skipped and the next ids fill its place.
+    std::vector<int32_t> ids;
+    std::optional<int32_t> cursor = afterId;
+    while (page.size() < limit) {
+        ids.clear();
+        {
+            std::shared_lock<std::shared_mutex> lock(m_orderMutex);
+            size_t wanted = limit - page.size();
+            if (descending) {
+                auto it = cursor ? m_order.lower_bound(*cursor) : m_order.end();
+                while (it != m_order.begin() && ids.size() < wanted) {
+                    ids.push_back(*--it);
+                }
+            } else {
+                auto it = cursor ? m_order.upper_bound(*cursor) : m_order.begin();
+                for (; it != m_order.end() && ids.size() < wanted; ++it) {
+                    ids.push_back(*it);
+                }
+            }
+        }
+        if (ids.empty()) break;
+
+        for (int32_t id : ids) {
+            if (auto character = getCharacter(id)) {
+                page.push_back(std::move(*character));
+            }
+        }
+        cursor = ids.back();
+    }
+    return page;
+}
+
+MemoryStorage::Stripe& MemoryStorage::stripeFor(int32_t id) {
+    return *m_stripes[static_cast<uint32_t>(id) % m_stripes.size()];
+}
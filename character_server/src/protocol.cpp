@@ -1,101 +1,197 @@
 #include "protocol.h"
 
+#include <algorithm>
 #include <cstring>
+#include <stdexcept>
 
-// Helper method to write primitive types to buffer
-template<typename T>
-void write_to_buffer(std::vector<uint8_t>& buffer, const T& value) {
-    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
-    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+size_t FrameHeader::encodedSize(uint8_t version) {
+    switch (version) {
+    case Protocol::FRAME_VERSION: return Protocol::FRAME_HEADER_SIZE;
+    case Protocol::FRAME_VERSION_PIPELINED: return Protocol::FRAME_HEADER_SIZE_PIPELINED;
+    default: return 0;
+    }
 }
 
-// Helper methods to read primitive types from buffer
-template<typename T>
-T read_from_buffer(const std::vector<uint8_t>& buffer, size_t& offset) {
-    T value;
-    memcpy(&value, buffer.data() + offset, sizeof(T));
-    offset += sizeof(T);
-    return value;
+size_t FrameHeader::encode(uint8_t* buffer) const {
+    buffer[0] = version;
+    buffer[1] = command;
+    std::memcpy(buffer + 2, &flags, sizeof(flags));
+    size_t offset = 4;
+    if (version == Protocol::FRAME_VERSION_PIPELINED) {
+        std::memcpy(buffer + offset, &requestId, sizeof(requestId));
+        offset += sizeof(requestId);
+    }
+    std::memcpy(buffer + offset, &length, sizeof(length));
+    return offset + sizeof(length);
 }
 
-void CharacterData::write_string(std::vector<uint8_t>& buffer, const std::string& str) {
-    uint32_t length = static_cast<uint32_t>(str.size());
-    write_to_buffer(buffer, length);
-    buffer.insert(buffer.end(), str.begin(), str.end());
+FrameHeader FrameHeader::decode(const uint8_t* buffer) {
+    FrameHeader header;
+    header.version = buffer[0];
+    header.command = buffer[1];
+    std::memcpy(&header.flags, buffer + 2, sizeof(header.flags));
+    size_t offset = 4;
+    if (header.version == Protocol::FRAME_VERSION_PIPELINED) {
+        std::memcpy(&header.requestId, buffer + offset, sizeof(header.requestId));
+        offset += sizeof(header.requestId);
+    }
+    std::memcpy(&header.length, buffer + offset, sizeof(header.length));
+    return header;
+}
+
+namespace {
+
+// Vector form: [count]([element size][character])*, the prefixes use the
+// encoding of the characters. The encoding is picked once per vector.
+
+template<typename Encoding>
+size_t vectorSize(const std::vector<CharacterData>& characters) {
+    using Prefix = Wire::Codec<uint32_t, Encoding>;
+    size_t size = Prefix::size(static_cast<uint32_t>(characters.size()));
+    for (const auto& character : characters) {
+        size_t elementSize = CharacterLayout::size<Encoding>(character);
+        size += Prefix::size(static_cast<uint32_t>(elementSize)) + elementSize;
+    }
+    return size;
 }
 
-std::string CharacterData::read_string(const std::vector<uint8_t>& buffer, size_t& offset) {
-    uint32_t length = read_from_buffer<uint32_t>(buffer, offset);
-    std::string str(buffer.begin() + offset, buffer.begin() + offset + length);
-    offset += length;
-    return str;
+template<typename Encoding>
+size_t vectorEncode(const std::vector<CharacterData>& characters, uint8_t* out) {
+    using Prefix = Wire::Codec<uint32_t, Encoding>;
+    uint8_t* position = out;
+    Prefix::encode(position, static_cast<uint32_t>(characters.size()));
+
+    for (const auto& character : characters) {
+        Prefix::encode(position, static_cast<uint32_t>(CharacterLayout::size<Encoding>(character)));
+        position += CharacterLayout::encode<Encoding>(character, position);
+    }
+    return static_cast<size_t>(position - out);
 }
 
-std::vector<uint8_t> CharacterData::serialize() const {
-    std::vector<uint8_t> buffer;
-    buffer.reserve(
-                // id
-                sizeof(id) +
-                // name size + name
-                sizeof(uint32_t) + name.size() +
-                // surname size + name
-                sizeof(uint32_t) + surname.size() +
-                // age
-                sizeof(uint8_t) +
-                // bio size + bio
-                sizeof(uint32_t) + bio.size()
-                );
-
-    write_to_buffer(buffer, id);
-    write_string(buffer, name);
-    write_string(buffer, surname);
-    write_to_buffer<uint8_t>(buffer, age);
-    write_string(buffer, bio);
+template<typename Encoding>
+std::vector<CharacterData> vectorDecode(const std::vector<uint8_t>& data) {
+    using Prefix = Wire::Codec<uint32_t, Encoding>;
+    size_t offset = 0;
+    uint32_t count = 0;
+    if (!Prefix::decode(data.data(), data.size(), offset, count)) {
+        throw std::runtime_error("Truncated character vector");
+    }
+    std::vector<CharacterData> characters;
+    // Every element takes at least its size prefix, a bogus count cannot over-reserve
+    characters.reserve(std::min<size_t>(count, (data.size() - offset) / Prefix::minSize));
+
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t size = 0;
+        if (!Prefix::decode(data.data(), data.size(), offset, size) || data.size() - offset < size) {
+            throw std::runtime_error("Truncated character vector");
+        }
+        // Elements are parsed in place, only the final strings are allocated
+        CharacterView view;
+        if (!CharacterViewLayout::decode<Encoding>(data.data() + offset, size, view)) {
+            throw std::runtime_error("Truncated character vector");
+        }
+        characters.push_back(view.toData());
+        offset += size;
+    }
+
+    return characters;
+}
+
+}
 
+std::vector<uint8_t> CharacterData::serialize() const {
+    std::vector<uint8_t> buffer(serializedSize());
+    serializeTo(buffer.data());
     return buffer;
 }
 
+size_t CharacterData::serializedSize(Wire::Mode mode) const {
+    if (mode == Wire::Mode::Compact) {
+        return CharacterLayout::size<Wire::Compact>(*this);
+    }
+    return CharacterLayout::size(*this);
+}
+
+size_t CharacterData::serializeTo(uint8_t* out, Wire::Mode mode) const {
+    if (mode == Wire::Mode::Compact) {
+        return CharacterLayout::encode<Wire::Compact>(*this, out);
+    }
+    return CharacterLayout::encode(*this, out);
+}
+
 CharacterData CharacterData::deserialize(const std::vector<uint8_t>& data) {
-    CharacterData character;
-    size_t offset = 0;
+    auto view = CharacterView::parse(data.data(), data.size());
+    if (!view) {
+        throw std::runtime_error("Truncated character data");
+    }
+    return view->toData();
+}
 
-    character.id = read_from_buffer<int>(data, offset);
-    character.name = read_string(data, offset);
-    character.surname = read_string(data, offset);
-    character.age = read_from_buffer<uint8_t>(data, offset);
-    character.bio = read_string(data, offset);
+CharacterView CharacterData::view() const {
+    CharacterView view;
+    view.id = id;
+    view.name = name;
+    view.surname = surname;
+    view.age = age;
+    view.bio = bio;
+    return view;
+}
 
+std::optional<CharacterView> CharacterView::parse(const uint8_t* data, size_t size, Wire::Mode mode) {
+    CharacterView view;
+    bool complete = mode == Wire::Mode::Compact
+            ? CharacterViewLayout::decode<Wire::Compact>(data, size, view)
+            : CharacterViewLayout::decode(data, size, view);
+    if (!complete) {
+        return std::nullopt;
+    }
+    return view;
+}
+
+CharacterData CharacterView::toData() const {
+    CharacterData character;
+    character.id = id;
+    character.name = std::string(name);
+    character.surname = std::string(surname);
+    character.age = age;
+    character.bio = std::string(bio);
     return character;
 }
 
 std::vector<uint8_t> CharacterData::serializeVector(const std::vector<CharacterData>& characters) {
-    std::vector<uint8_t> buffer;
-    uint32_t count = static_cast<uint32_t>(characters.size());
-    write_to_buffer(buffer, count);
+    std::vector<uint8_t> buffer(serializedVectorSize(characters));
+    serializeVectorTo(characters, buffer.data());
+    return buffer;
+}
 
-    for (const auto& character : characters) {
-        std::vector<uint8_t> char_data = character.serialize();
-        uint32_t size = static_cast<uint32_t>(char_data.size());
-        write_to_buffer(buffer, size);
-        buffer.insert(buffer.end(), char_data.begin(), char_data.end());
+size_t CharacterData::serializedVectorSize(const std::vector<CharacterData>& characters, Wire::Mode mode) {
+    if (mode == Wire::Mode::Compact) {
+        return vectorSize<Wire::Compact>(characters);
     }
+    return vectorSize<Wire::Fixed>(characters);
+}
 
-    return buffer;
+size_t CharacterData::serializeVectorTo(const std::vector<CharacterData>& characters, uint8_t* out,
+                                        Wire::Mode mode) {
+    if (mode == Wire::Mode::Compact) {
+        return vectorEncode<Wire::Compact>(characters, out);
+    }
+    return vectorEncode<Wire::Fixed>(characters, out);
 }
 
-std::vector<CharacterData> CharacterData::deserializeVector(const std::vector<uint8_t>& data) {
-    size_t offset = 0;
-    uint32_t count = read_from_buffer<uint32_t>(data, offset);
-    std::vector<CharacterData> characters;
-    characters.reserve(count);
+void CharacterData::appendTo(std::vector<uint8_t>& buffer) const {
+    uint32_t size = static_cast<uint32_t>(serializedSize());
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(size) + size);
 
-    for (uint32_t i = 0; i < count; ++i) {
-        uint32_t size = read_from_buffer<uint32_t>(data, offset);
-        std::vector<uint8_t> char_data(data.begin() + offset,
-                                      data.begin() + offset + size);
-        characters.push_back(deserialize(char_data));
-        offset += size;
-    }
+    uint8_t* position = buffer.data() + offset;
+    Wire::Codec<uint32_t>::encode(position, size);
+    serializeTo(position);
+}
 
-    return characters;
+std::vector<CharacterData> CharacterData::deserializeVector(const std::vector<uint8_t>& data, Wire::Mode mode) {
+    if (mode == Wire::Mode::Compact) {
+        return vectorDecode<Wire::Compact>(data);
+    }
+    return vectorDecode<Wire::Fixed>(data);
 }
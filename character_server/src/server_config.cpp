@@ -0,0 +1,140 @@
+#include "server_config.h"
+
+#include <stdexcept>
+
+namespace {
+
+// Parses a positive integer option value
+size_t parseCount(const std::string& name, const std::string& value) {
+    size_t parsed = 0;
+    try {
+        size_t end = 0;
+        parsed = std::stoul(value, &end);
+        if (end != value.size()) {
+            throw std::invalid_argument(value);
+        }
+    } catch (const std::exception&) {
+        throw std::invalid_argument("Invalid value for --" + name + ": " + value);
+    }
+    if (parsed == 0) {
+        throw std::invalid_argument("--" + name + " must be greater than zero");
+    }
+    return parsed;
+}
+
+}
+
+ServerConfig ServerConfig::fromCommandLine(int argc, char* argv[]) {
+    ServerConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument.compare(0, 2, "--") != 0) {
+            throw std::invalid_argument("Unexpected argument: " + argument);
+        }
+
+        size_t separator = argument.find('=');
+        std::string name = argument.substr(2, separator == std::string::npos ? std::string::npos : separator - 2);
+        std::string value = separator == std::string::npos ? std::string() : argument.substr(separator + 1);
+
+        if (name == "backend") {
+            if (value == "mysql") {
+                config.backend = Backend::MySql;
+            } else if (value == "memory") {
+                config.backend = Backend::Memory;
+            } else if (value == "log") {
+                config.backend = Backend::Log;
+            } else {
+                throw std::invalid_argument("Unknown backend: " + value);
+            }
+        } else if (name == "port") {
+            size_t port = parseCount(name, value);
+            if (port > 65535) {
+                throw std::invalid_argument("Invalid port: " + value);
+            }
+            config.port = static_cast<unsigned short>(port);
+        } else if (name == "io-threads") {
+            config.ioThreads = parseCount(name, value);
+        } else if (name == "io-mode") {
+            if (value == "shared") {
+                config.ioMode = IoMode::Shared;
+            } else if (value == "sharded") {
+                config.ioMode = IoMode::Sharded;
+            } else {
+                throw std::invalid_argument("Unknown io mode: " + value);
+            }
+        } else if (name == "pin-cpus") {
+            config.pinCpus = true;
+        } else if (name == "max-queued") {
+            config.maxQueued = parseCount(name, value);
+        } else if (name == "session-queue") {
+            config.sessionQueue = parseCount(name, value);
+            if (config.sessionQueue > 65535) {
+                throw std::invalid_argument("Invalid session queue: " + value);
+            }
+        } else if (name == "db-host") {
+            config.dbHost = value;
+        } else if (name == "db-user") {
+            config.dbUser = value;
+        } else if (name == "db-password") {
+            config.dbPass = value;
+        } else if (name == "db-name") {
+            config.dbName = value;
+        } else if (name == "db-pool-size") {
+            config.dbPoolSize = parseCount(name, value);
+        } else if (name == "db-mode") {
+            if (value == "blocking") {
+                config.dbMode = DbMode::Blocking;
+            } else if (value == "async") {
+                config.dbMode = DbMode::Async;
+            } else {
+                throw std::invalid_argument("Unknown db mode: " + value);
+            }
+        } else if (name == "db-async-connections") {
+            config.dbAsyncConnections = parseCount(name, value);
+        } else if (name == "data-dir") {
+            config.dataDir = value;
+        } else if (name == "snapshot") {
+            config.snapshotPath = value;
+        } else {
+            throw std::invalid_argument("Unknown option: --" + name);
+        }
+    }
+
+    if (!config.snapshotPath.empty() && config.backend == Backend::Memory) {
+        throw std::invalid_argument("--snapshot needs a persistent backend");
+    }
+    if (config.dbMode == DbMode::Async &&
+            (config.backend != Backend::MySql || !config.snapshotPath.empty())) {
+        throw std::invalid_argument("--db-mode=async needs --backend=mysql without --snapshot");
+    }
+    if (config.dbMode == DbMode::Async && config.ioMode == IoMode::Sharded) {
+        throw std::invalid_argument("--db-mode=async needs --io-mode=shared");
+    }
+
+    return config;
+}
+
+std::string ServerConfig::usage() {
+    return
+        "Options:\n"
+        "  --backend=mysql|memory|log\n"
+        "                           Storage engine (default: mysql)\n"
+        "  --port=N                 Listening port (default: 12345)\n"
+        "  --io-threads=N           Threads running socket I/O (default: 1)\n"
+        "  --io-mode=shared|sharded One io_context for all threads, or one per thread\n"
+        "                           with its own SO_REUSEPORT acceptor (default: shared)\n"
+        "  --pin-cpus               Pin each I/O thread to its own CPU, Linux only\n"
+        "  --max-queued=N           Requests queued server-wide before BUSY replies (default: 4096)\n"
+        "  --session-queue=N        Pipelined requests per connection before its reads\n"
+        "                           pause (default: 64)\n"
+        "  --db-host=HOST           MySQL host (default: localhost)\n"
+        "  --db-user=USER           MySQL user\n"
+        "  --db-password=PASSWORD   MySQL password\n"
+        "  --db-name=NAME           MySQL database\n"
+        "  --db-pool-size=N         Pooled MySQL connections (default: 16)\n"
+        "  --db-mode=blocking|async MySQL query execution (default: blocking)\n"
+        "  --db-async-connections=N Non-blocking MySQL connections (default: 64)\n"
+        "  --data-dir=PATH          Directory of the log backend (default: data)\n"
+        "  --snapshot=PATH          Snapshot file for warm restarts, UNIX only\n";
+}
@@ -1,6 +1,25 @@
 #include "server_instance.h"
+#include "database_manager.h"
+#include "memory_storage.h"
 #include "session_manager.h"
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_LOG_STORAGE
+#include "log_storage.h"
+#endif
+
+#ifdef HAVE_MYSQL_NONBLOCKING
+#include "async_database.h"
+#endif
+
+#ifdef HAVE_SNAPSHOT
+#include "snapshot.h"
+#include "warm_start_storage.h"
+#endif
 
 #ifdef WIN32
 #include <windows.h>
@@ -10,6 +29,38 @@
 #include <fcntl.h>
 #endif
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+// Pins the calling thread, I/O thread i gets CPU i
+void pinToCpu(size_t index) {
+#ifdef __linux__
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cpus, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        std::cerr << "Cannot pin I/O thread " << index << std::endl;
+    }
+#else
+    (void)index;
+#endif
+}
+
+void printWorkerStats(const std::string& name, const SessionManager& sessionManager) {
+    WorkStealingPool::Stats stats = sessionManager.workerStats();
+    std::cout << name << ": " << stats.threads << " threads, " << stats.executed << " run, "
+              << stats.stolen << " stolen, " << stats.lifoHits << " from LIFO slot, "
+              << stats.queued << " queued (max " << stats.maxQueued << "), "
+              << sessionManager.rejectedRequests() << " rejected as busy" << std::endl;
+}
+
+}
+
 ServerInstance& ServerInstance::getInstance() {
     static ServerInstance instance;
     return instance;
@@ -60,16 +111,44 @@ void ServerInstance::cleanupSingleInstanceLock() {
 #endif
 }
 
-bool ServerInstance::initialize(unsigned short port) {
+bool ServerInstance::initialize(const ServerConfig& config) {
     try {
-        if (!DatabaseManager::getInstance().initialize("localhost", "character_user", "secure_password_123", "character_db")) {
+        m_config = config;
+        if (!initializeStorage()) {
             return false;
         }
 
-        m_sessionManager = std::make_shared<SessionManager>(m_ioContext);
+        AsyncDatabase* asyncDatabase = nullptr;
+        if (m_config.dbMode == ServerConfig::DbMode::Async) {
+#ifdef HAVE_MYSQL_NONBLOCKING
+            ConnectionPool::Settings settings;
+            settings.host = m_config.dbHost;
+            settings.user = m_config.dbUser;
+            settings.pass = m_config.dbPass;
+            settings.db = m_config.dbName;
+            settings.size = m_config.dbAsyncConnections;
+
+            m_asyncDatabase = std::make_unique<AsyncDatabase>(m_ioContext, DatabaseManager::getInstance().cache());
+            m_asyncDatabase->initialize(settings);
+            asyncDatabase = m_asyncDatabase.get();
+            std::cout << "MySQL execution: async (" << settings.size << " connections)" << std::endl;
+#else
+            std::cerr << "Async MySQL execution needs MariaDB Connector/C" << std::endl;
+            return false;
+#endif
+        }
+
+        if (m_config.ioMode == ServerConfig::IoMode::Sharded) {
+            return initializeShards();
+        }
+
+        SessionLimits limits;
+        limits.maxQueued = m_config.maxQueued;
+        limits.sessionQueue = m_config.sessionQueue;
+        m_sessionManager = std::make_shared<SessionManager>(m_ioContext, *m_storage, asyncDatabase, limits);
         m_acceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(
             m_ioContext,
-            boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)
+            boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), m_config.port)
         );
 
         m_sessionManager->startAccept(*m_acceptor);
@@ -80,17 +159,191 @@ bool ServerInstance::initialize(unsigned short port) {
     }
 }
 
+bool ServerInstance::initializeShards() {
+#ifdef SO_REUSEPORT
+    using ReusePort = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+    using boost::asio::ip::tcp;
+
+    // Workers, connections and queued requests are split, so the totals stay
+    // those of the shared mode
+    size_t count = m_config.ioThreads;
+    SessionLimits limits;
+    limits.workerThreads = std::max<size_t>(1, WorkStealingPool::defaultSize() / count);
+    limits.maxConnections = (Protocol::MAX_CONNECTIONS + count - 1) / count;
+    limits.maxQueued = (m_config.maxQueued + count - 1) / count;
+    limits.sessionQueue = m_config.sessionQueue;
+    tcp::endpoint endpoint(tcp::v4(), m_config.port);
+
+    for (size_t i = 0; i < count; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->acceptor = std::make_unique<tcp::acceptor>(shard->ioContext);
+        shard->acceptor->open(endpoint.protocol());
+        shard->acceptor->set_option(tcp::acceptor::reuse_address(true));
+        // Every shard listens on the port, the kernel spreads new connections over them
+        shard->acceptor->set_option(ReusePort(true));
+        shard->acceptor->bind(endpoint);
+        shard->acceptor->listen();
+
+        shard->sessionManager = std::make_shared<SessionManager>(shard->ioContext, *m_storage, nullptr, limits);
+        shard->sessionManager->startAccept(*shard->acceptor);
+        m_shards.push_back(std::move(shard));
+    }
+
+    std::cout << "I/O: " << count << " shards with " << limits.workerThreads << " workers each" << std::endl;
+    return true;
+#else
+    std::cerr << "Sharded I/O needs SO_REUSEPORT" << std::endl;
+    return false;
+#endif
+}
+
+bool ServerInstance::initializeStorage() {
+    if (!m_config.snapshotPath.empty()) {
+#ifdef HAVE_SNAPSHOT
+        auto snapshot = Snapshot::open(m_config.snapshotPath);
+        if (snapshot) {
+            // Only a snapshot written at a clean shutdown may be served, so it
+            // is consumed here and a crash leads to a cold start
+            std::remove(m_config.snapshotPath.c_str());
+            std::cout << "Serving " << snapshot->size() << " characters from snapshot "
+                      << m_config.snapshotPath << " while storage starts" << std::endl;
+            m_warmStart = std::make_unique<WarmStartStorage>(std::move(snapshot),
+                                                             [this] { return openStorage(); });
+            m_storage = m_warmStart.get();
+            return true;
+        }
+#else
+        std::cerr << "Snapshots are not available on this platform" << std::endl;
+        return false;
+#endif
+    }
+
+    m_storage = openStorage();
+    return m_storage != nullptr;
+}
+
+StorageBackend* ServerInstance::openStorage() {
+    switch (m_config.backend) {
+    case ServerConfig::Backend::MySql: {
+        auto& database = DatabaseManager::getInstance();
+        if (!database.initialize(m_config.dbHost, m_config.dbUser, m_config.dbPass,
+                                 m_config.dbName, m_config.dbPoolSize)) {
+            std::cerr << "Failed to connect to MySQL at " << m_config.dbHost << std::endl;
+            return nullptr;
+        }
+        std::cout << "Storage: MySQL (" << m_config.dbPoolSize << " connections)" << std::endl;
+        return &database;
+    }
+
+    case ServerConfig::Backend::Memory:
+        m_ownedStorage = std::make_unique<MemoryStorage>();
+        std::cout << "Storage: in-memory, data is not persisted" << std::endl;
+        return m_ownedStorage.get();
+
+    case ServerConfig::Backend::Log: {
+#ifdef HAVE_LOG_STORAGE
+        auto storage = std::make_unique<LogStorage>(m_config.dataDir);
+        if (!storage->open()) {
+            std::cerr << "Failed to open log storage in " << m_config.dataDir << std::endl;
+            return nullptr;
+        }
+        m_ownedStorage = std::move(storage);
+        std::cout << "Storage: log in " << m_config.dataDir << std::endl;
+        return m_ownedStorage.get();
+#else
+        std::cerr << "Log storage is not available on this platform" << std::endl;
+        return nullptr;
+#endif
+    }
+    }
+    return nullptr;
+}
+
 void ServerInstance::run() {
-    std::cout << "Server started. Press Ctrl+C to exit." << std::endl;
-    m_ioContext.run();
+    std::cout << "Server started with " << m_config.ioThreads
+              << " I/O thread(s). Press Ctrl+C to exit." << std::endl;
+
+#ifndef __linux__
+    if (m_config.pinCpus) {
+        std::cerr << "CPU pinning is only available on Linux" << std::endl;
+    }
+#endif
+
+    // Shared: sessions and the async database serialize their handlers on
+    // strands, so any thread may run any handler. Sharded: thread i runs shard i.
+    auto contextOf = [this](size_t index) -> boost::asio::io_context& {
+        return m_shards.empty() ? m_ioContext : m_shards[index]->ioContext;
+    };
+    auto runThread = [this, &contextOf](size_t index) {
+        if (m_config.pinCpus) {
+            pinToCpu(index);
+        }
+        contextOf(index).run();
+    };
+
+    // Handled like any other completion, so shutdown may take locks and allocate
+    m_signals = std::make_unique<boost::asio::signal_set>(contextOf(0), SIGINT, SIGTERM);
+    m_signals->async_wait([this](const boost::system::error_code& ec, int) {
+        if (ec) return;
+        std::cout << "\nShutting down server..." << std::endl;
+        stop();
+    });
+
+    std::vector<std::thread> threads;
+    threads.reserve(m_config.ioThreads - 1);
+    for (size_t i = 1; i < m_config.ioThreads; ++i) {
+        threads.emplace_back(runThread, i);
+    }
+    runThread(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    shutdown();
+    saveSnapshot();
+}
+
+void ServerInstance::saveSnapshot() {
+#ifdef HAVE_SNAPSHOT
+    // Until the live backend is open the warm start storage streams the old snapshot,
+    // so this also works if the backend never came up
+    if (!m_config.snapshotPath.empty() && m_storage) {
+        Snapshot::write(m_config.snapshotPath, *m_storage);
+    }
+#endif
 }
 
 void ServerInstance::stop() {
     m_ioContext.stop();
+    for (auto& shard : m_shards) {
+        shard->ioContext.stop();
+    }
+}
+
+void ServerInstance::shutdown() {
+    m_signals.reset();
+
+    // No handler runs anymore, the acceptors and sessions are only used here
     if (m_acceptor) {
         m_acceptor->close();
     }
     if (m_sessionManager) {
         m_sessionManager->stop();
     }
+    for (auto& shard : m_shards) {
+        shard->acceptor->close();
+        shard->sessionManager->stop();
+    }
+
+    if (m_config.backend == ServerConfig::Backend::MySql) {
+        auto cache = DatabaseManager::getInstance().cacheStats();
+        std::cout << "Character cache: " << cache.hits << " hits, "
+                  << cache.misses << " misses, " << cache.evictions << " evictions, "
+                  << cache.entries << " entries (" << cache.bytes << " bytes)" << std::endl;
+    }
+    if (m_sessionManager) {
+        printWorkerStats("Workers", *m_sessionManager);
+    }
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+        printWorkerStats("Shard " + std::to_string(i) + " workers", *m_shards[i]->sessionManager);
+    }
 }
@@ -1,10 +1,95 @@
 #include "session_manager.h"
+
+#ifdef HAVE_MYSQL_NONBLOCKING
+#include "async_database.h"
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <sstream>
 #include <iostream>
 
-SessionManager::SessionManager(boost::asio::io_context& ioContext)
+namespace {
+
+// Response buffers are sized exactly and the characters are serialized
+// straight behind the response prefix, one allocation per response
+
+std::vector<uint8_t> makeCharactersResponse(uint8_t command, const std::vector<CharacterData>& characters,
+                                            Wire::Mode mode) {
+    if (characters.empty()) {
+        return {command};
+    }
+    std::vector<uint8_t> response(1 + CharacterData::serializedVectorSize(characters, mode));
+    response[0] = command;
+    CharacterData::serializeVectorTo(characters, response.data() + 1, mode);
+    return response;
+}
+
+// GET_ALL response, packed if the request accepts it, see Protocol::FRAME_FLAG_PACKED
+std::vector<uint8_t> makeGetAllResponse(std::vector<CharacterData>& characters, uint16_t requestFlags,
+                                        bool allowDeflate, uint16_t& responseFlags) {
+    Wire::Mode mode = (requestFlags & Protocol::FRAME_FLAG_COMPACT) ? Wire::Mode::Compact : Wire::Mode::Fixed;
+    if (!(requestFlags & Protocol::FRAME_FLAG_PACKED)) {
+        return makeCharactersResponse(Protocol::GET_ALL, characters, mode);
+    }
+
+    // Ids become small deltas, short varints in compact mode and runs zlib picks up
+    std::sort(characters.begin(), characters.end(),
+              [](const CharacterData& a, const CharacterData& b) { return a.id < b.id; });
+    uint32_t previous = 0;
+    for (auto& character : characters) {
+        uint32_t id = static_cast<uint32_t>(character.id);
+        character.id = static_cast<int32_t>(id - previous);
+        previous = id;
+    }
+    responseFlags |= Protocol::FRAME_FLAG_PACKED;
+    auto response = makeCharactersResponse(Protocol::GET_ALL, characters, mode);
+
+#ifdef HAVE_ZLIB
+    size_t payloadSize = response.size() - 1;
+    if (allowDeflate && payloadSize >= Protocol::PACK_COMPRESS_THRESHOLD) {
+        uint32_t inflatedSize = static_cast<uint32_t>(payloadSize);
+        uLongf deflatedSize = compressBound(payloadSize);
+        std::vector<uint8_t> compressed(1 + sizeof(inflatedSize) + deflatedSize);
+        compressed[0] = Protocol::GET_ALL;
+        std::memcpy(compressed.data() + 1, &inflatedSize, sizeof(inflatedSize));
+
+        // Fastest level, GET_ALL is compressed to relieve the link, not to archive
+        uint8_t* body = compressed.data() + 1 + sizeof(inflatedSize);
+        if (compress2(body, &deflatedSize, response.data() + 1, payloadSize, Z_BEST_SPEED) == Z_OK &&
+                sizeof(inflatedSize) + deflatedSize < payloadSize) {
+            compressed.resize(1 + sizeof(inflatedSize) + deflatedSize);
+            responseFlags |= Protocol::FRAME_FLAG_DEFLATE;
+            return compressed;
+        }
+    }
+#else
+    (void)allowDeflate;
+#endif
+    return response;
+}
+
+std::vector<uint8_t> makeCharacterResponse(uint8_t command, const CharacterData& character, Wire::Mode mode) {
+    std::vector<uint8_t> response(1 + character.serializedSize(mode));
+    response[0] = command;
+    character.serializeTo(response.data() + 1, mode);
+    return response;
+}
+
+}
+
+SessionManager::SessionManager(boost::asio::io_context& ioContext, StorageBackend& storage,
+                               AsyncDatabase* asyncDatabase, const SessionLimits& limits)
     : m_ioContext(ioContext),
-      m_threadPool(Protocol::THREAD_POOL_SIZE) {}
+      m_storage(storage),
+      m_asyncDatabase(asyncDatabase),
+      m_threadPool(limits.workerThreads),
+      m_limits(limits) {}
 
 SessionManager::~SessionManager() {
     stop();
@@ -22,11 +107,40 @@ void SessionManager::startAccept(boost::asio::ip::tcp::acceptor& acceptor) {
 }
 
 void SessionManager::stop() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_stopping = true;
+    std::vector<std::shared_ptr<Session>> sessions;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        for (const auto& entry : m_sessions) {
+            if (auto session = entry.second.lock()) {
+                sessions.push_back(std::move(session));
+            }
+        }
+    }
+
+    // Nothing runs on the strands anymore, closing here ends the streams and
+    // releases the requests the workers would answer
+    for (const auto& session : sessions) {
+        session->close();
+    }
     m_threadPool.join();
 }
 
+bool SessionManager::admit() {
+    size_t queued = m_queued.load(std::memory_order_relaxed);
+    do {
+        if (queued >= m_limits.maxQueued) {
+            ++m_rejected;
+            return false;
+        }
+    } while (!m_queued.compare_exchange_weak(queued, queued + 1));
+    return true;
+}
+
+void SessionManager::release() {
+    --m_queued;
+}
+
 void SessionManager::handleAccept(std::shared_ptr<Session> session,
                                 boost::asio::ip::tcp::acceptor& acceptor,
                                 const boost::system::error_code& error) {
@@ -37,25 +151,32 @@ void SessionManager::handleAccept(std::shared_ptr<Session> session,
         return;
     }
 
-    if (m_activeConnections >= Protocol::MAX_CONNECTIONS) {
+    if (m_activeConnections >= m_limits.maxConnections) {
         std::cerr << "Connection limit reached ("
-                 << Protocol::MAX_CONNECTIONS << ")" << std::endl;
+                 << m_limits.maxConnections << ")" << std::endl;
         return;
     }
 
     ++m_activeConnections;
-    session->start();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sessions.emplace(session.get(), session);
+    }
+    // The socket's executor is the session strand, start there like every later handler
+    boost::asio::post(session->socket().get_executor(), [session]() { session->start(); });
     startAccept(acceptor);
 }
 
 // Session implementation
 SessionManager::Session::Session(boost::asio::io_context& ioContext,
                                SessionManager& manager)
-    : m_socket(ioContext),
-      m_timeoutTimer(ioContext),
+    : m_strand(boost::asio::make_strand(ioContext)),
+      m_socket(m_strand),
+      m_timeoutTimer(m_strand),
+      m_writeTimer(m_strand),
       m_manager(manager)
 {
-
+    m_options.pipelineDepth = manager.m_limits.sessionQueue;
 }
 
 void SessionManager::Session::start() {
@@ -97,7 +218,12 @@ void SessionManager::Session::readHeader() {
             if (!ec) self->m_socket.cancel();
         });
 
-    // Command byte
+    if (m_framing == Framing::Length) {
+        readFrame(0);
+        return;
+    }
+
+    // Command byte, or the first byte of a frame header
     m_readBuffer.resize(1);
 
     boost::asio::async_read(m_socket,
@@ -108,12 +234,161 @@ void SessionManager::Session::readHeader() {
                 self->close();
                 return;
             }
+
+            // The first byte of the connection selects the framing
+            if (self->m_framing == Framing::Unknown) {
+                if (FrameHeader::encodedSize(self->m_readBuffer[0]) > 0) {
+                    self->m_framing = Framing::Length;
+                    self->m_frameVersion = self->m_readBuffer[0];
+                } else {
+                    self->m_framing = Framing::Legacy;
+                }
+            }
+            if (self->m_framing == Framing::Length) {
+                self->m_frameHeader[0] = self->m_readBuffer[0];
+                self->readFrame(1);
+                return;
+            }
+
             // get the command byte and read the rest of message
             self->m_currentCommand = self->m_readBuffer[0];
             self->readBody();
         });
 }
 
+void SessionManager::Session::readFrame(size_t received) {
+    // Timer was set by readHeader and covers the whole frame
+    size_t headerSize = FrameHeader::encodedSize(m_frameVersion);
+    boost::asio::async_read(m_socket,
+        boost::asio::buffer(m_frameHeader.data() + received, headerSize - received),
+        [self = shared_from_this()](const boost::system::error_code& ec, size_t) {
+            if (ec) {
+                self->m_timeoutTimer.cancel();
+                self->close();
+                return;
+            }
+
+            FrameHeader header = FrameHeader::decode(self->m_frameHeader.data());
+            // The version is fixed for the connection by its first frame
+            if (header.version != self->m_frameVersion || header.length > Protocol::MAX_FRAME_SIZE) {
+                self->m_timeoutTimer.cancel();
+                std::cerr << "Invalid frame header, closing session" << std::endl;
+                self->close();
+                return;
+            }
+
+            // Payload is read in one exact read, straight into the message buffer
+            auto message = std::make_shared<std::vector<uint8_t>>(header.length);
+            Request request{header.command, header.requestId,
+                            static_cast<uint16_t>(header.flags | self->m_options.defaultFlags)};
+            boost::asio::async_read(self->m_socket, boost::asio::buffer(*message),
+                [self, message, request](const boost::system::error_code& ec, size_t) {
+                    self->m_timeoutTimer.cancel();
+                    if (ec) {
+                        self->close();
+                        return;
+                    }
+
+                    if (self->m_frameVersion != Protocol::FRAME_VERSION_PIPELINED) {
+                        // Next request is read once the response is written
+                        self->dispatch(request, std::move(*message));
+                        return;
+                    }
+
+                    // Pipelined: keep reading while the request runs, up to the depth limit
+                    ++self->m_inFlight;
+                    self->dispatch(request, std::move(*message));
+                    if (self->m_inFlight < self->m_options.pipelineDepth) {
+                        self->readHeader();
+                    } else {
+                        self->m_readPaused = true;
+                    }
+                });
+        });
+}
+
+void SessionManager::Session::dispatch(const Request& request, std::vector<uint8_t>&& message) {
+    if (request.command == Protocol::HELLO) {
+        hello(request, message);
+        return;
+    }
+    m_receivedRequest = true;
+
+    // Answered right here if that cannot block, otherwise by the async
+    // database or the thread pool
+    if (processInline(request, message)) {
+        return;
+    }
+
+    // Queued work is bounded server-wide, past the limit the client is told to back off
+    if (!m_manager.admit()) {
+        sendResponse(request, {Protocol::RESP_BUSY});
+        return;
+    }
+    Request admitted = request;
+    admitted.admitted = true;
+
+    if (!processAsync(admitted, message)) {
+        boost::asio::post(m_manager.m_threadPool,
+                          [self = shared_from_this(), request = admitted, message = std::move(message)]() mutable {
+            self->processMessage(request, std::move(message));
+        });
+    }
+}
+
+void SessionManager::Session::hello(const Request& request, const std::vector<uint8_t>& message) {
+    Hello offer;
+    // Only length-prefixed frames carry the flags the options act on
+    if (m_framing != Framing::Length || m_receivedRequest ||
+            !HelloLayout::decode(message.data(), message.size(), offer) || offer.version == 0) {
+        std::cerr << "Invalid HELLO, closing session" << std::endl;
+        fail(request);
+        return;
+    }
+    m_receivedRequest = true;
+
+    uint32_t supported = Protocol::CAP_COMPACT | Protocol::CAP_PACKED;
+#ifdef HAVE_ZLIB
+    supported |= Protocol::CAP_DEFLATE;
+#endif
+    if (m_frameVersion == Protocol::FRAME_VERSION_PIPELINED) {
+        supported |= Protocol::CAP_PIPELINED;
+    }
+
+    HelloReply reply;
+    reply.version = std::min(offer.version, Protocol::PROTOCOL_VERSION);
+    reply.capabilities = offer.capabilities & supported;
+    reply.pipelineDepth = 1;
+    if (reply.capabilities & Protocol::CAP_PIPELINED) {
+        size_t limit = std::min<size_t>(m_manager.m_limits.sessionQueue, UINT16_MAX);
+        reply.pipelineDepth = static_cast<uint16_t>(offer.pipelineDepth == 0
+                ? limit
+                : std::min<size_t>(offer.pipelineDepth, limit));
+    }
+
+    m_options.defaultFlags = 0;
+    if (reply.capabilities & Protocol::CAP_COMPACT) {
+        m_options.defaultFlags |= Protocol::FRAME_FLAG_COMPACT;
+    }
+    if (reply.capabilities & Protocol::CAP_PACKED) {
+        m_options.defaultFlags |= Protocol::FRAME_FLAG_PACKED;
+    }
+    m_options.deflate = (reply.capabilities & Protocol::CAP_DEFLATE) != 0;
+    m_options.pipelineDepth = reply.pipelineDepth;
+    m_options.maxResponseSize = offer.maxFrameSize;
+    m_options.streamChunkSize = Protocol::STREAM_CHUNK_SIZE;
+    if (offer.maxFrameSize != 0) {
+        m_options.streamChunkSize = std::min<size_t>(m_options.streamChunkSize, offer.maxFrameSize);
+    }
+    reply.streamChunkSize = static_cast<uint32_t>(m_options.streamChunkSize);
+
+    std::vector<uint8_t> response(1 + HelloReplyLayout::size(reply));
+    response[0] = Protocol::HELLO;
+    HelloReplyLayout::encode(reply, response.data() + 1);
+
+    sendResponse(request, std::move(response));
+}
+
 void SessionManager::Session::readBody() {
     // Clear previous content but keep capacity
     m_readBuffer.clear();
@@ -158,11 +433,7 @@ void SessionManager::Session::readBody() {
                     self->m_readBuffer.begin() + bytes_transferred
                     );
 
-        // Process message in thread pool
-        boost::asio::post(self->m_manager.m_threadPool,
-                          [self, message = std::move(message)]() mutable {
-            self->processMessage(std::move(message));
-        });
+        self->dispatch(Request{self->m_currentCommand, 0}, std::move(message));
 
         // tcp stacks messages, so read further
         if (!self->m_readBuffer.empty()) {
@@ -171,127 +442,615 @@ void SessionManager::Session::readBody() {
     });
 }
 
-void SessionManager::Session::processMessage(std::vector<uint8_t>&& message) {
+void SessionManager::Session::processMessage(const Request& request, std::vector<uint8_t>&& message) {
     try {
-        std::vector<uint8_t> response;
-        size_t offset = 0;
+        switch (request.command) {
+        case Protocol::GET_ALL_STREAM: {
+            // Chunks come serialized from the storage, always in the fixed encoding
+            Request stream = request;
+            stream.flags &= ~Protocol::FRAME_FLAG_COMPACT;
+            streamNext(stream, std::nullopt);
+            break;
+        }
 
-        switch (m_currentCommand) {
-        case Protocol::GET_ALL: {
-            auto characters = DatabaseManager::getInstance().getAllCharacters();
-            response.push_back(Protocol::GET_ALL);
+        case Protocol::MULTI:
+            sendResponse(request, processMulti(request, message));
+            break;
 
-            if (!characters.empty()) {
-                auto char_data = CharacterData::serializeVector(characters);
-                response.insert(response.end(), char_data.begin(), char_data.end());
-            }
-            sendResponse(std::move(response));
+        default: {
+            uint16_t flags = 0;
+            auto response = execute(request, message, flags);
+            sendResponse(request, std::move(response), flags);
             break;
         }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Processing error: " << e.what() << std::endl;
+        fail(request);
+    }
+}
+
+std::vector<uint8_t> SessionManager::Session::execute(const Request& request, const std::vector<uint8_t>& message,
+                                                      uint16_t& flags) {
+    std::vector<uint8_t> response;
+
+    switch (request.command) {
+    case Protocol::GET_ALL: {
+        auto characters = m_manager.m_storage.getAllCharacters();
+        return makeGetAllResponse(characters, request.flags, m_options.deflate, flags);
+    }
+
+    case Protocol::GET_RANGE: {
+        if (message.size() < sizeof(uint8_t) + sizeof(int32_t) + sizeof(uint32_t)) {
+            throw std::runtime_error("Invalid message size for GET_RANGE");
+        }
+        uint8_t rangeFlags = message[0];
+        int32_t cursor = 0;
+        uint32_t limit = 0;
+        std::memcpy(&cursor, message.data() + sizeof(rangeFlags), sizeof(cursor));
+        std::memcpy(&limit, message.data() + sizeof(rangeFlags) + sizeof(cursor), sizeof(limit));
+        if (limit == 0) {
+            throw std::runtime_error("GET_RANGE limit must be greater than zero");
+        }
+        limit = std::min(limit, Protocol::RANGE_MAX_LIMIT);
+
+        std::optional<int32_t> afterId;
+        if (rangeFlags & Protocol::RANGE_AFTER_CURSOR) {
+            afterId = cursor;
+        }
+
+        // One extra row tells whether another page follows
+        auto characters = m_manager.m_storage.getCharacterRange(
+                    afterId, limit + 1, (rangeFlags & Protocol::RANGE_DESCENDING) != 0);
+        uint8_t more = characters.size() > limit ? 1 : 0;
+        if (more) {
+            characters.resize(limit);
+        }
+        // Continuation token, sent back with RANGE_AFTER_CURSOR for the next page
+        int32_t next = characters.empty() ? cursor : characters.back().id;
+
+        size_t prefixSize = 2 + sizeof(next);
+        response.resize(prefixSize + CharacterData::serializedVectorSize(characters, request.mode()));
+        response[0] = Protocol::GET_RANGE;
+        response[1] = more;
+        std::memcpy(response.data() + 2, &next, sizeof(next));
+        CharacterData::serializeVectorTo(characters, response.data() + prefixSize, request.mode());
+        return response;
+    }
+
+    case Protocol::GET_ONE: {
+        if (message.size() < sizeof(int)) {
+            throw std::runtime_error("Invalid message size for GET_ONE");
+        }
+        int id = 0;
+        std::memcpy(&id, message.data(), sizeof(id));
+
+        if (auto character = m_manager.m_storage.getCharacter(id)) {
+            return makeCharacterResponse(Protocol::GET_ONE, *character, request.mode());
+        }
+        return {Protocol::RESP_ERROR};
+    }
+
+    case Protocol::ADD_CHARACTER: {
+        auto character = CharacterView::parse(message.data(), message.size(), request.mode());
+        if (!character) {
+            throw std::runtime_error("Invalid character data for ADD_CHARACTER");
+        }
+        if (!m_manager.m_storage.addCharacter(*character)) {
+            throw std::runtime_error("Failed to add character");
+        }
+        return {Protocol::RESP_SUCCESS};
+    }
+
+    case Protocol::ADD_CHARACTERS: {
+        auto characters = CharacterData::deserializeVector(message, request.mode());
+        auto ids = m_manager.m_storage.addCharacters(characters);
+        if (!ids) {
+            throw std::runtime_error("Failed to add characters");
+        }
+
+        // Generated ids in request order, prefixed with their count
+        uint32_t count = static_cast<uint32_t>(ids->size());
+        response.reserve(1 + sizeof(count) + ids->size() * sizeof(int32_t));
+        response.push_back(Protocol::ADD_CHARACTERS);
+        const uint8_t* countBytes = reinterpret_cast<const uint8_t*>(&count);
+        response.insert(response.end(), countBytes, countBytes + sizeof(count));
+        const uint8_t* idBytes = reinterpret_cast<const uint8_t*>(ids->data());
+        response.insert(response.end(), idBytes, idBytes + ids->size() * sizeof(int32_t));
+        return response;
+    }
+
+    case Protocol::REMOVE_CHARACTER: {
+        if (message.size() < sizeof(int)) {
+            throw std::runtime_error("Invalid message size for REMOVE_CHARACTER");
+        }
+        int32_t id;
+        std::memcpy(&id, message.data(), sizeof(id));
+
+        if (m_manager.m_storage.deleteCharacter(id)) {
+            return {Protocol::RESP_SUCCESS};
+        }
+        return {Protocol::RESP_ERROR};
+    }
+
+    case Protocol::UPDATE_CHARACTER: {
+        // The id to update is the id of the record
+        auto character = CharacterView::parse(message.data(), message.size(), request.mode());
+        if (!character) {
+            throw std::runtime_error("Invalid character data for UPDATE_CHARACTER");
+        }
+
+        if (!m_manager.m_storage.updateCharacter(character->id, *character)) {
+            throw std::runtime_error("Failed to update character");
+        }
+        return {Protocol::RESP_SUCCESS};
+    }
+
+    default: {
+        std::ostringstream error;
+        error << "Unknown command received: 0x" << std::hex << static_cast<int>(request.command);
+        throw std::runtime_error(error.str());
+    }
+    }
+}
+
+std::vector<uint8_t> SessionManager::Session::processMulti(const Request& request,
+                                                           const std::vector<uint8_t>& message) {
+    struct Command {
+        uint8_t command;
+        std::vector<uint8_t> payload;
+    };
+
+    // The whole envelope is checked before anything runs
+    uint32_t count = 0;
+    if (message.size() < sizeof(count)) {
+        throw std::runtime_error("Invalid message size for MULTI");
+    }
+    std::memcpy(&count, message.data(), sizeof(count));
+    if (count > Protocol::MAX_MULTI_COMMANDS) {
+        throw std::runtime_error("Too many commands in MULTI");
+    }
+
+    std::vector<Command> commands;
+    commands.reserve(count);
+    size_t offset = sizeof(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t length = 0;
+        if (message.size() - offset < sizeof(uint8_t) + sizeof(length)) {
+            throw std::runtime_error("Truncated MULTI");
+        }
+        uint8_t command = message[offset];
+        std::memcpy(&length, message.data() + offset + 1, sizeof(length));
+        offset += sizeof(uint8_t) + sizeof(length);
+        if (message.size() - offset < length) {
+            throw std::runtime_error("Truncated MULTI");
+        }
+        if (command == Protocol::MULTI || command == Protocol::GET_ALL_STREAM || command == Protocol::HELLO) {
+            throw std::runtime_error("Command cannot be nested in MULTI");
+        }
+        commands.push_back({command, std::vector<uint8_t>(message.begin() + offset,
+                                                          message.begin() + offset + length)});
+        offset += length;
+    }
+
+    // Commands keep the frame's encoding, GET_ALL is answered unpacked
+    Request inner = request;
+    inner.flags &= Protocol::FRAME_FLAG_COMPACT;
+    std::vector<std::vector<uint8_t>> responses(commands.size());
+
+    for (size_t i = 0; i < commands.size();) {
+        // Consecutive GET_ONE share one storage call, a single query on MySQL
+        size_t end = i;
+        std::vector<int32_t> ids;
+        while (end < commands.size() && commands[end].command == Protocol::GET_ONE &&
+               commands[end].payload.size() >= sizeof(int32_t)) {
+            int32_t id = 0;
+            std::memcpy(&id, commands[end].payload.data(), sizeof(id));
+            ids.push_back(id);
+            ++end;
+        }
+        if (ids.size() > 1) {
+            auto characters = m_manager.m_storage.getCharacters(ids);
+            for (size_t k = 0; k < characters.size(); ++k) {
+                responses[i + k] = characters[k]
+                        ? makeCharacterResponse(Protocol::GET_ONE, *characters[k], inner.mode())
+                        : std::vector<uint8_t>{Protocol::RESP_ERROR};
+            }
+            i = end;
+            continue;
+        }
+
+        inner.command = commands[i].command;
+        try {
+            uint16_t flags = 0;
+            responses[i] = execute(inner, commands[i].payload, flags);
+        } catch (const std::exception& e) {
+            std::cerr << "Processing error in MULTI: " << e.what() << std::endl;
+            responses[i] = {Protocol::RESP_ERROR};
+        }
+        ++i;
+    }
+
+    size_t size = 1 + sizeof(count);
+    for (const auto& response : responses) {
+        size += sizeof(uint32_t) + response.size();
+    }
+    std::vector<uint8_t> combined(size);
+    combined[0] = Protocol::MULTI;
+    std::memcpy(combined.data() + 1, &count, sizeof(count));
+    uint8_t* out = combined.data() + 1 + sizeof(count);
+    for (const auto& response : responses) {
+        uint32_t length = static_cast<uint32_t>(response.size());
+        std::memcpy(out, &length, sizeof(length));
+        std::memcpy(out + sizeof(length), response.data(), response.size());
+        out += sizeof(length) + response.size();
+    }
+    return combined;
+}
+
+bool SessionManager::Session::processInline(const Request& request, std::vector<uint8_t>& message) {
+    StorageBackend& storage = m_manager.m_storage;
+
+    switch (request.command) {
+    case Protocol::GET_ONE: {
+        // Malformed requests take the regular path, which reports them
+        int32_t id = 0;
+        if (message.size() < sizeof(id)) {
+            return false;
+        }
+        std::memcpy(&id, message.data(), sizeof(id));
+
+        std::optional<CharacterData> character;
+        if (!storage.tryGetCharacter(id, character)) {
+            return false;
+        }
+        sendResponse(request, character ? makeCharacterResponse(Protocol::GET_ONE, *character, request.mode())
+                                        : std::vector<uint8_t>{Protocol::RESP_ERROR});
+        return true;
+    }
+
+    case Protocol::ADD_CHARACTER:
+    case Protocol::UPDATE_CHARACTER:
+    case Protocol::REMOVE_CHARACTER:
+        if (!storage.hasNonBlockingWrites()) {
+            return false;
+        }
+        processMessage(request, std::move(message));
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool SessionManager::Session::processAsync(const Request& request, const std::vector<uint8_t>& message) {
+#ifdef HAVE_MYSQL_NONBLOCKING
+    AsyncDatabase* database = m_manager.m_asyncDatabase;
+    if (!database) {
+        return false;
+    }
+
+    auto self = shared_from_this();
+    // Same replies as processMessage, failed writes end the session there too
+    auto replyWrite = [self, request](bool ok) {
+        if (ok) {
+            self->sendResponse(request, {Protocol::RESP_SUCCESS});
+        } else {
+            std::cerr << "Processing error: write failed" << std::endl;
+            self->fail(request);
+        }
+    };
+
+    try {
+        switch (request.command) {
+        case Protocol::GET_ALL:
+            database->getAllCharacters([self, request](std::optional<std::vector<CharacterData>> characters) {
+                if (!characters) {
+                    self->sendResponse(request, {Protocol::RESP_ERROR});
+                    return;
+                }
+                uint16_t flags = 0;
+                auto response = makeGetAllResponse(*characters, request.flags, self->m_options.deflate, flags);
+                self->sendResponse(request, std::move(response), flags);
+            });
+            return true;
 
         case Protocol::GET_ONE: {
-            if (message.size() < sizeof(int)) {
+            if (message.size() < sizeof(int32_t)) {
                 throw std::runtime_error("Invalid message size for GET_ONE");
-                return;
             }
-            int id = 0;
+            int32_t id = 0;
             std::memcpy(&id, message.data(), sizeof(id));
 
-            if (auto character = DatabaseManager::getInstance().getCharacter(id)) {
-                auto charData = character->serialize();
-                response.push_back(Protocol::GET_ONE);
-                response.insert(response.end(), charData.begin(), charData.end());
-                sendResponse(std::move(response));
-            } else {
-                sendResponse({Protocol::RESP_ERROR});
-            }
-            break;
+            database->getCharacter(id, [self, request](std::optional<CharacterData> character) {
+                if (!character) {
+                    self->sendResponse(request, {Protocol::RESP_ERROR});
+                    return;
+                }
+                self->sendResponse(request, makeCharacterResponse(Protocol::GET_ONE, *character, request.mode()));
+            });
+            return true;
         }
 
         case Protocol::ADD_CHARACTER: {
-            CharacterData character = CharacterData::deserialize(message);
-            if (DatabaseManager::getInstance().addCharacter(character)) {
-                sendResponse({Protocol::RESP_SUCCESS});
-            } else {
-                throw std::runtime_error("Failed to add character");
+            auto character = CharacterView::parse(message.data(), message.size(), request.mode());
+            if (!character) {
+                throw std::runtime_error("Invalid character data for ADD_CHARACTER");
             }
-            break;
+            database->addCharacter(character->toData(), replyWrite);
+            return true;
         }
 
         case Protocol::REMOVE_CHARACTER: {
-            if (message.size() < sizeof(int)) {
+            if (message.size() < sizeof(int32_t)) {
                 throw std::runtime_error("Invalid message size for REMOVE_CHARACTER");
             }
-            int32_t id;
+            int32_t id = 0;
             std::memcpy(&id, message.data(), sizeof(id));
 
-            if (DatabaseManager::getInstance().deleteCharacter(id)) {
-                sendResponse({Protocol::RESP_SUCCESS});
-            } else {
-                sendResponse({Protocol::RESP_ERROR});
-            }
-            break;
+            database->deleteCharacter(id, [self, request](bool ok) {
+                self->sendResponse(request, {ok ? Protocol::RESP_SUCCESS : Protocol::RESP_ERROR});
+            });
+            return true;
         }
 
         case Protocol::UPDATE_CHARACTER: {
-            if (message.size() < sizeof(int)) {
-                throw std::runtime_error("Invalid message size for UPDATE_CHARACTER");
+            auto character = CharacterView::parse(message.data(), message.size(), request.mode());
+            if (!character) {
+                throw std::runtime_error("Invalid character data for UPDATE_CHARACTER");
             }
-            int id;
-            std::memcpy(&id, message.data(), sizeof(id));
+            database->updateCharacter(character->id, character->toData(), replyWrite);
+            return true;
+        }
 
-            CharacterData character = CharacterData::deserialize(message);
+        default:
+            // GET_ALL_STREAM, ADD_CHARACTERS and GET_RANGE stay on the blocking path
+            return false;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Processing error: " << e.what() << std::endl;
+        fail(request);
+        return true;
+    }
+#else
+    (void)request;
+    (void)message;
+    return false;
+#endif
+}
 
-            if (DatabaseManager::getInstance().updateCharacter(id, character)) {
-                sendResponse({Protocol::RESP_SUCCESS});
-            } else {
-                throw std::runtime_error("Failed to update character");
-            }
-            break;
+void SessionManager::Session::sendResponse(const Request& request, std::vector<uint8_t> &&data,
+                                           uint16_t flags) {
+    if (request.admitted) {
+        m_manager.release();
+    }
+    // A response the client cannot take is turned into an error
+    if (m_options.maxResponseSize != 0) {
+        uint64_t payloadSize = data.empty() ? 0 : data.size() - 1;
+        if (flags & Protocol::FRAME_FLAG_DEFLATE) {
+            // The client inflates the body, so the inflated size has to fit
+            uint32_t inflatedSize = 0;
+            std::memcpy(&inflatedSize, data.data() + 1, sizeof(inflatedSize));
+            payloadSize = inflatedSize;
+        }
+        if (payloadSize > m_options.maxResponseSize) {
+            data = {Protocol::RESP_ERROR};
+            flags = 0;
         }
+    }
+    // The first byte of a response is its command byte or response code
+    uint8_t command = data.empty() ? Protocol::RESP_ERROR : data[0];
+    enqueue(makeOutgoing(request, command, std::move(data), 1, flags));
+}
 
-        default: {
-            std::cerr << "Unknown command received: 0x" << std::hex
-                      << static_cast<int>(m_currentCommand) << std::endl;
-            sendResponse({Protocol::RESP_ERROR});
-            close();
-            break;
+void SessionManager::Session::fail(const Request& request) {
+    if (request.admitted) {
+        m_manager.release();
+    }
+    auto outgoing = makeOutgoing(request, Protocol::RESP_ERROR, {}, 0);
+    // Closing right away would drop the error reply that is still queued
+    outgoing->onWritten = [self = shared_from_this()](const boost::system::error_code&) {
+        self->close();
+    };
+    enqueue(std::move(outgoing));
+}
+
+void SessionManager::Session::streamNext(const Request& request, std::optional<int32_t> afterId) {
+    std::vector<uint8_t> chunk;
+    try {
+        if (!m_manager.m_storage.readStreamChunk(afterId, m_options.streamChunkSize, chunk)) {
+            throw std::runtime_error("Failed to stream characters");
         }
+        // Only a single character larger than the client's limit gets here
+        if (m_options.maxResponseSize != 0 && chunk.size() > m_options.maxResponseSize) {
+            throw std::runtime_error("Streamed character exceeds the response size limit");
         }
     } catch (const std::exception& e) {
         std::cerr << "Processing error: " << e.what() << std::endl;
-        sendResponse({Protocol::RESP_ERROR});
-        close();
+        fail(request);
+        return;
+    }
+
+    uint32_t count = 0;
+    std::memcpy(&count, chunk.data(), sizeof(count));
+    if (count == 0) {
+        // Chunk with zero characters terminates the stream
+        sendResponse(request, {Protocol::GET_ALL_STREAM, 0, 0, 0, 0});
+        return;
     }
+
+    auto frame = makeOutgoing(request, request.command, std::move(chunk), 0);
+    frame->final = false;
+    frame->onWritten = [self = shared_from_this(), request, afterId](const boost::system::error_code& ec) {
+        if (ec) {
+            // The session is closing, the stream ends here
+            if (request.admitted) {
+                self->m_manager.release();
+            }
+            return;
+        }
+        boost::asio::post(self->m_manager.m_threadPool, [self, request, afterId]() {
+            self->streamNext(request, afterId);
+        });
+    };
+    enqueue(std::move(frame));
 }
 
-void SessionManager::Session::sendResponse(std::vector<uint8_t> &&data) {
-    // Set timeout
-    m_timeoutTimer.expires_after(std::chrono::milliseconds(Protocol::WRITE_TIMEOUT));
-    m_timeoutTimer.async_wait(
+void SessionManager::Session::enqueue(std::shared_ptr<Outgoing> outgoing) {
+    // Responses come from workers and database handlers, the queue lives on the strand.
+    // Inline responses are already on it and are queued without another hop.
+    boost::asio::dispatch(m_socket.get_executor(),
+                      [self = shared_from_this(), outgoing = std::move(outgoing)]() mutable {
+        if (self->m_closed) {
+            if (outgoing->onWritten) {
+                outgoing->onWritten(boost::asio::error::operation_aborted);
+            }
+            return;
+        }
+        self->m_writeQueue.push_back(std::move(outgoing));
+        if (!self->m_writing) {
+            self->writeNext();
+        }
+    });
+}
+
+void SessionManager::Session::writeNext() {
+    if (m_writeQueue.empty()) {
+        m_writing = false;
+        return;
+    }
+    m_writing = true;
+
+    // Everything queued meanwhile goes out in one write, bounded so a
+    // large backlog does not hold back the first responses
+    m_writeBatch.clear();
+    m_writeBuffers.clear();
+    size_t batchBytes = 0;
+    while (!m_writeQueue.empty() && m_writeBatch.size() < Protocol::MAX_WRITE_BATCH_FRAMES &&
+           batchBytes < Protocol::MAX_WRITE_BATCH_BYTES) {
+        auto& outgoing = m_writeQueue.front();
+        for (const auto& buffer : outgoing->buffers()) {
+            if (buffer.size() > 0) {
+                m_writeBuffers.push_back(buffer);
+                batchBytes += buffer.size();
+            }
+        }
+        m_writeBatch.push_back(std::move(outgoing));
+        m_writeQueue.pop_front();
+    }
+
+    // Set timeout, a stream chunk that does not drain gives up the stream sooner
+    bool streaming = std::any_of(m_writeBatch.begin(), m_writeBatch.end(),
+                                 [](const auto& outgoing) { return !outgoing->final; });
+    m_writeTimer.expires_after(std::chrono::milliseconds(
+            streaming ? Protocol::STREAM_WRITE_TIMEOUT : Protocol::WRITE_TIMEOUT));
+    m_writeTimer.async_wait(
         [self = shared_from_this()](const boost::system::error_code& ec) {
             if (!ec) self->m_socket.cancel();
         });
 
-    data.insert(data.end(), Protocol::MESSAGE_DELIMITER.begin(), Protocol::MESSAGE_DELIMITER.end());
-
+    // m_writeBatch keeps the buffers alive until the handler runs
     boost::asio::async_write(m_socket,
-        boost::asio::buffer(data),
+        m_writeBuffers,
         [self = shared_from_this()](const boost::system::error_code& ec, size_t) {
-            self->m_timeoutTimer.cancel();
-            if (!ec) {
-                // Continue processing
-                self->readHeader();
-            } else {
-                self->close();
-            }
+            self->handleWrite(ec);
         });
 }
 
+void SessionManager::Session::handleWrite(const boost::system::error_code& ec) {
+    m_writeTimer.cancel();
+
+    bool readNext = false;
+    for (const auto& outgoing : m_writeBatch) {
+        if (outgoing->onWritten) {
+            outgoing->onWritten(ec);
+        }
+        if (ec || !outgoing->final) {
+            continue;
+        }
+        if (m_frameVersion != Protocol::FRAME_VERSION_PIPELINED) {
+            // Continue processing
+            readNext = true;
+        } else if (m_inFlight > 0) {
+            --m_inFlight;
+            if (m_readPaused) {
+                m_readPaused = false;
+                readNext = true;
+            }
+        }
+    }
+    m_writeBatch.clear();
+
+    if (ec) {
+        // Nothing queued will be written anymore, release waiting streams
+        for (auto& queued : m_writeQueue) {
+            if (queued->onWritten) {
+                queued->onWritten(ec);
+            }
+        }
+        m_writeQueue.clear();
+        close();
+        return;
+    }
+
+    if (readNext) {
+        readHeader();
+    }
+    writeNext();
+}
+
+std::shared_ptr<SessionManager::Session::Outgoing> SessionManager::Session::makeOutgoing(
+        const Request& request, uint8_t command, std::vector<uint8_t>&& data, size_t payloadOffset,
+        uint16_t flags) const {
+    auto outgoing = std::make_shared<Outgoing>();
+    outgoing->data = std::move(data);
+    outgoing->payloadOffset = std::min(payloadOffset, outgoing->data.size());
+
+    if (m_framing == Framing::Length) {
+        FrameHeader header;
+        header.version = m_frameVersion;
+        header.command = command;
+        header.requestId = request.id;
+        header.flags = (request.flags & Protocol::FRAME_FLAG_COMPACT) | flags;
+        header.length = static_cast<uint32_t>(outgoing->data.size() - outgoing->payloadOffset);
+        outgoing->headerSize = header.encode(outgoing->header.data());
+    } else {
+        outgoing->header[0] = command;
+        outgoing->headerSize = 1;
+        outgoing->delimited = true;
+    }
+    return outgoing;
+}
+
+std::array<boost::asio::const_buffer, 3> SessionManager::Session::Outgoing::buffers() const {
+    return {
+        boost::asio::buffer(header.data(), headerSize),
+        boost::asio::buffer(data.data() + payloadOffset, data.size() - payloadOffset),
+        boost::asio::buffer(Protocol::MESSAGE_DELIMITER.data(), delimited ? Protocol::MESSAGE_DELIMITER.size() : 0)
+    };
+}
+
 void SessionManager::Session::close() {
+    // Reached from several handlers when a session fails, count it once
+    if (m_closed.exchange(true)) {
+        return;
+    }
     boost::system::error_code ec;
     m_timeoutTimer.cancel(ec);
+    m_writeTimer.cancel(ec);
     m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
     m_socket.close(ec);
+
+    // Frames not yet written never will be, complete them now
+    auto queued = std::move(m_writeQueue);
+    m_writeQueue.clear();
+    for (auto& outgoing : queued) {
+        if (outgoing->onWritten) {
+            outgoing->onWritten(boost::asio::error::operation_aborted);
+        }
+    }
+
     --m_manager.m_activeConnections;
+    std::lock_guard<std::mutex> lock(m_manager.m_mutex);
+    m_manager.m_sessions.erase(this);
 }
@@ -0,0 +1,278 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t SNAPSHOT_MAGIC = 0x50534353; ///< "CSSP"
+constexpr uint32_t SNAPSHOT_VERSION = 1; ///< Snapshot format version
+// magic, version, count, index offset
+constexpr size_t HEADER_SIZE = sizeof(uint32_t) * 3 + sizeof(uint64_t);
+
+}
+
+bool Snapshot::write(const std::string& path, StorageBackend& source) {
+    std::string temporaryPath = path + ".tmp";
+    FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Cannot create snapshot " << temporaryPath << std::endl;
+        return false;
+    }
+
+    auto fail = [&]() {
+        std::fclose(file);
+        std::remove(temporaryPath.c_str());
+        return false;
+    };
+
+    // Header is rewritten once the count and the index position are known
+    uint8_t header[HEADER_SIZE] = {0};
+    if (std::fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        return fail();
+    }
+
+    std::vector<IndexEntry> index;
+    uint64_t offset = HEADER_SIZE;
+    bool written = true;
+
+    // Records are copied out of the stream chunks as they arrive
+    bool streamed = source.streamAllCharacters(Protocol::STREAM_CHUNK_SIZE,
+                                               [&](std::vector<uint8_t>&& chunk) {
+        uint32_t count = 0;
+        std::memcpy(&count, chunk.data(), sizeof(count));
+        size_t position = sizeof(count);
+
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t size = 0;
+            std::memcpy(&size, chunk.data() + position, sizeof(size));
+            position += sizeof(size);
+
+            IndexEntry entry{};
+            std::memcpy(&entry.id, chunk.data() + position, sizeof(entry.id));
+            entry.size = size;
+            entry.offset = offset;
+            index.push_back(entry);
+
+            if (std::fwrite(chunk.data() + position, 1, size, file) != size) {
+                written = false;
+                return false;
+            }
+            position += size;
+            offset += size;
+        }
+        return true;
+    });
+    if (!streamed || !written) {
+        return fail();
+    }
+
+    std::sort(index.begin(), index.end(),
+              [](const IndexEntry& a, const IndexEntry& b) { return a.id < b.id; });
+
+    // Align the index so it can be used in place from the mapping
+    uint64_t indexOffset = (offset + alignof(IndexEntry) - 1) / alignof(IndexEntry) * alignof(IndexEntry);
+    const uint8_t padding[alignof(IndexEntry)] = {0};
+    if (std::fwrite(padding, 1, indexOffset - offset, file) != indexOffset - offset ||
+            std::fwrite(index.data(), sizeof(IndexEntry), index.size(), file) != index.size()) {
+        return fail();
+    }
+
+    uint32_t count = static_cast<uint32_t>(index.size());
+    std::memcpy(header, &SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    std::memcpy(header + 4, &SNAPSHOT_VERSION, sizeof(SNAPSHOT_VERSION));
+    std::memcpy(header + 8, &count, sizeof(count));
+    std::memcpy(header + 12, &indexOffset, sizeof(indexOffset));
+    if (std::fseek(file, 0, SEEK_SET) != 0 ||
+            std::fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+            std::fflush(file) != 0 || ::fsync(fileno(file)) != 0) {
+        return fail();
+    }
+
+    std::fclose(file);
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+
+    std::cout << "Wrote snapshot of " << count << " characters to " << path << std::endl;
+    return true;
+}
+
+std::unique_ptr<Snapshot> Snapshot::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < HEADER_SIZE) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    size_t length = static_cast<size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto invalid = [&]() -> std::unique_ptr<Snapshot> {
+        std::cerr << path << " is not a valid snapshot" << std::endl;
+        ::munmap(mapping, length);
+        return nullptr;
+    };
+
+    const uint8_t* data = static_cast<const uint8_t*>(mapping);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t count = 0;
+    uint64_t indexOffset = 0;
+    std::memcpy(&magic, data, sizeof(magic));
+    std::memcpy(&version, data + 4, sizeof(version));
+    std::memcpy(&count, data + 8, sizeof(count));
+    std::memcpy(&indexOffset, data + 12, sizeof(indexOffset));
+
+    if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION ||
+            indexOffset % alignof(IndexEntry) != 0 || indexOffset > length ||
+            (length - indexOffset) / sizeof(IndexEntry) < count) {
+        return invalid();
+    }
+
+    // Bounds are checked once here, lookups trust the index afterwards
+    const auto* index = reinterpret_cast<const IndexEntry*>(data + indexOffset);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (index[i].offset < HEADER_SIZE || index[i].offset > indexOffset ||
+                indexOffset - index[i].offset < index[i].size ||
+                (i > 0 && index[i - 1].id >= index[i].id)) {
+            return invalid();
+        }
+    }
+
+    return std::unique_ptr<Snapshot>(new Snapshot(mapping, length, index, count));
+}
+
+Snapshot::Snapshot(void* mapping, size_t length, const IndexEntry* index, uint32_t count)
+    : m_mapping(mapping),
+      m_length(length),
+      m_index(index),
+      m_count(count)
+{
+
+}
+
+Snapshot::~Snapshot() {
+    if (m_mapping) {
+        ::munmap(m_mapping, m_length);
+    }
+}
+
+std::optional<CharacterData> Snapshot::getCharacter(int32_t id) const {
+    const IndexEntry* end = m_index + m_count;
+    const IndexEntry* entry = std::lower_bound(m_index, end, id,
+                                               [](const IndexEntry& e, int32_t key) { return e.id < key; });
+    if (entry == end || entry->id != id) {
+        return std::nullopt;
+    }
+    return read(*entry);
+}
+
+std::vector<CharacterData> Snapshot::getAllCharacters() const {
+    std::vector<CharacterData> characters;
+    characters.reserve(m_count);
+    for (uint32_t i = 0; i < m_count; ++i) {
+        if (auto character = read(m_index[i])) {
+            characters.push_back(std::move(*character));
+        }
+    }
+    return characters;
+}
+
+std::vector<CharacterData> Snapshot::getCharacterRange(std::optional<int32_t> afterId,
+                                                      size_t limit, bool descending) const {
+    std::vector<CharacterData> characters;
+    const IndexEntry* end = m_index + m_count;
+    auto idLess = [](const IndexEntry& e, int32_t key) { return e.id < key; };
+
+    if (!descending) {
+        const IndexEntry* entry = m_index;
+        if (afterId) {
+            entry = std::upper_bound(m_index, end, *afterId,
+                                     [](int32_t key, const IndexEntry& e) { return key < e.id; });
+        }
+        for (; entry != end && characters.size() < limit; ++entry) {
+            if (auto character = read(*entry)) {
+                characters.push_back(std::move(*character));
+            }
+        }
+    } else {
+        // Walks backwards from the first entry not before the cursor
+        const IndexEntry* entry = afterId ? std::lower_bound(m_index, end, *afterId, idLess) : end;
+        while (entry != m_index && characters.size() < limit) {
+            --entry;
+            if (auto character = read(*entry)) {
+                characters.push_back(std::move(*character));
+            }
+        }
+    }
+    return characters;
+}
+
+bool Snapshot::streamAllCharacters(size_t chunkSize, const StorageBackend::ChunkSink& sink) const {
+    const uint8_t* data = static_cast<const uint8_t*>(m_mapping);
+    std::vector<uint8_t> chunk;
+    uint32_t count = 0;
+    auto startChunk = [&]() {
+        chunk.clear();
+        chunk.reserve(chunkSize + chunkSize / 4);
+        count = 0;
+        chunk.resize(sizeof(count));
+    };
+    auto finishChunk = [&]() {
+        std::memcpy(chunk.data(), &count, sizeof(count));
+        return sink(std::move(chunk));
+    };
+
+    startChunk();
+    for (uint32_t i = 0; i < m_count; ++i) {
+        // Records are stored serialized, they are only checked and copied as they are
+        const IndexEntry& entry = m_index[i];
+        auto view = CharacterView::parse(data + entry.offset, entry.size);
+        if (!view || view->id != entry.id) {
+            continue;
+        }
+        const uint8_t* size = reinterpret_cast<const uint8_t*>(&entry.size);
+        chunk.insert(chunk.end(), size, size + sizeof(entry.size));
+        chunk.insert(chunk.end(), data + entry.offset, data + entry.offset + entry.size);
+        ++count;
+
+        if (chunk.size() >= chunkSize) {
+            if (!finishChunk()) return false;
+            startChunk();
+        }
+    }
+
+    if (count > 0) {
+        return finishChunk();
+    }
+    return true;
+}
+
+std::optional<CharacterData> Snapshot::read(const IndexEntry& entry) const {
+    // Parsed in place, a damaged record is reported as missing instead of throwing
+    const uint8_t* record = static_cast<const uint8_t*>(m_mapping) + entry.offset;
+    auto view = CharacterView::parse(record, entry.size);
+    if (!view || view->id != entry.id) {
+        return std::nullopt;
+    }
+    return view->toData();
+}
@@ -0,0 +1,195 @@
+#include "statement_cache.h"
+
+#include <vector>
+
+namespace {
+
+/**
+ * \struct StatementDefinition
+ * \brief SQL text and parameter layout of a cached statement
+ */
+struct StatementDefinition {
+    const char* sql; ///< Statement text
+    std::vector<enum_field_types> params; ///< Parameter buffer types, in order
+    bool returnsCharacters; ///< Whether the result is bound to the character row
+};
+
+// Indexed by StatementCache::Id
+const StatementDefinition DEFINITIONS[StatementCache::STATEMENT_COUNT] = {
+    // INSERT_CHARACTER: name, surname, age, bio
+    {"INSERT INTO characters (name, surname, age, bio) VALUES (?, ?, ?, ?)",
+     {MYSQL_TYPE_STRING, MYSQL_TYPE_STRING, MYSQL_TYPE_TINY, MYSQL_TYPE_STRING}, false},
+    // UPDATE_CHARACTER: name, surname, age, bio, id
+    {"UPDATE characters SET name = ?, surname = ?, age = ?, bio = ? WHERE id = ?",
+     {MYSQL_TYPE_STRING, MYSQL_TYPE_STRING, MYSQL_TYPE_TINY, MYSQL_TYPE_STRING, MYSQL_TYPE_LONG}, false},
+    // DELETE_CHARACTER: id
+    {"DELETE FROM characters WHERE id = ?",
+     {MYSQL_TYPE_LONG}, false},
+    // SELECT_CHARACTER: id
+    {"SELECT id, name, surname, age, bio FROM characters WHERE id = ?",
+     {MYSQL_TYPE_LONG}, true},
+    // SELECT_RANGE_ASC: cursor id, row limit
+    {"SELECT id, name, surname, age, bio FROM characters WHERE id > ? ORDER BY id LIMIT ?",
+     {MYSQL_TYPE_LONGLONG, MYSQL_TYPE_LONGLONG}, true},
+    // SELECT_RANGE_DESC: cursor id, row limit
+    {"SELECT id, name, surname, age, bio FROM characters WHERE id < ? ORDER BY id DESC LIMIT ?",
+     {MYSQL_TYPE_LONGLONG, MYSQL_TYPE_LONGLONG}, true},
+};
+
+}
+
+StatementCache::StatementCache(MYSQL* connection)
+    : m_connection(connection),
+      m_batchParams(BATCH_INSERT_ROWS * BATCH_INSERT_PARAMS)
+{
+    for (size_t id = 0; id < STATEMENT_COUNT; ++id) {
+        const auto& types = DEFINITIONS[id].params;
+        for (size_t i = 0; i < types.size(); ++i) {
+            m_params[id][i].buffer_type = types[i];
+            // Age is the only TINY parameter and it is an uint8_t
+            m_params[id][i].is_unsigned = types[i] == MYSQL_TYPE_TINY;
+        }
+    }
+
+    // Every row of a multi-row INSERT has the INSERT_CHARACTER layout
+    for (size_t i = 0; i < m_batchParams.size(); ++i) {
+        m_batchParams[i] = m_params[INSERT_CHARACTER][i % BATCH_INSERT_PARAMS];
+    }
+
+    // ID
+    m_row.bind[0].buffer_type = MYSQL_TYPE_LONG;
+    m_row.bind[0].buffer = &m_row.id;
+
+    // Name
+    m_row.bind[1].buffer_type = MYSQL_TYPE_STRING;
+    m_row.bind[1].buffer = m_row.name;
+    m_row.bind[1].buffer_length = sizeof(m_row.name);
+
+    // Surname
+    m_row.bind[2].buffer_type = MYSQL_TYPE_STRING;
+    m_row.bind[2].buffer = m_row.surname;
+    m_row.bind[2].buffer_length = sizeof(m_row.surname);
+
+    // Age
+    m_row.bind[3].buffer_type = MYSQL_TYPE_LONG;
+    m_row.bind[3].buffer = &m_row.age;
+
+    // Bio
+    m_row.bind[4].buffer_type = MYSQL_TYPE_STRING;
+    m_row.bind[4].buffer = m_row.bio;
+    m_row.bind[4].buffer_length = sizeof(m_row.bio);
+
+    for (size_t i = 0; i < 5; ++i) {
+        m_row.bind[i].length = &m_row.length[i];
+        m_row.bind[i].is_null = &m_row.isNull[i];
+        m_row.bind[i].error = &m_row.error[i];
+    }
+}
+
+StatementCache::~StatementCache() {
+    for (auto* stmt : m_statements) {
+        if (stmt) {
+            mysql_stmt_close(stmt);
+        }
+    }
+    for (auto* stmt : {m_batchInsert.stmt, m_tailInsert.stmt}) {
+        if (stmt) {
+            mysql_stmt_close(stmt);
+        }
+    }
+}
+
+MYSQL_STMT* StatementCache::get(Id id) {
+    if (m_statements[id]) {
+        return m_statements[id];
+    }
+
+    MYSQL_STMT* stmt = mysql_stmt_init(m_connection);
+    if (!stmt) return nullptr;
+
+    const auto& definition = DEFINITIONS[id];
+    std::string query = definition.sql;
+    if (mysql_stmt_prepare(stmt, query.c_str(), query.length()) != 0) {
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+
+    if (definition.returnsCharacters && mysql_stmt_bind_result(stmt, m_row.bind) != 0) {
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+
+    m_statements[id] = stmt;
+    return stmt;
+}
+
+MYSQL_STMT* StatementCache::getBatchInsert(size_t rows) {
+    if (rows == 0 || rows > BATCH_INSERT_ROWS) return nullptr;
+
+    BatchInsert& slot = rows == BATCH_INSERT_ROWS ? m_batchInsert : m_tailInsert;
+    if (slot.stmt && slot.rows == rows) {
+        return slot.stmt;
+    }
+    if (slot.stmt) {
+        mysql_stmt_close(slot.stmt);
+        slot = BatchInsert();
+    }
+
+    MYSQL_STMT* stmt = mysql_stmt_init(m_connection);
+    if (!stmt) return nullptr;
+
+    std::string query = "INSERT INTO characters (name, surname, age, bio) VALUES ";
+    query.reserve(query.size() + rows * 16);
+    for (size_t i = 0; i < rows; ++i) {
+        query += i == 0 ? "(?, ?, ?, ?)" : ", (?, ?, ?, ?)";
+    }
+
+    if (mysql_stmt_prepare(stmt, query.c_str(), query.length()) != 0) {
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+
+    slot.stmt = stmt;
+    slot.rows = rows;
+    return stmt;
+}
+
+bool StatementCache::fetchCharacter(MYSQL_STMT* stmt, CharacterData& character) {
+    int status = mysql_stmt_fetch(stmt);
+    if (status != 0 && status != MYSQL_DATA_TRUNCATED) {
+        return false;
+    }
+
+    character.id = m_row.id;
+    character.name = readString(stmt, 1, m_row.name);
+    character.surname = readString(stmt, 2, m_row.surname);
+    character.age = static_cast<uint8_t>(m_row.age);
+    character.bio = readString(stmt, 4, m_row.bio);
+    return true;
+}
+
+void StatementCache::bindString(MYSQL_BIND& bind, std::string_view value) {
+    bind.buffer = const_cast<char*>(value.data());
+    bind.buffer_length = value.length();
+}
+
+std::string StatementCache::readString(MYSQL_STMT* stmt, unsigned int column, const char* buffer) {
+    if (m_row.isNull[column]) {
+        return {};
+    }
+
+    if (!m_row.error[column]) {
+        return std::string(buffer, m_row.length[column]);
+    }
+
+    // Value did not fit into the bound buffer, fetch the whole column
+    std::string value(m_row.length[column], '\0');
+    MYSQL_BIND bind{};
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = &value[0];
+    bind.buffer_length = value.size();
+    if (mysql_stmt_fetch_column(stmt, &bind, column, 0) != 0) {
+        return std::string(buffer, m_row.bind[column].buffer_length);
+    }
+    return value;
+}
@@ -0,0 +1,157 @@
+#include "warm_start_storage.h"
+
+#include <iostream>
+
+WarmStartStorage::WarmStartStorage(std::unique_ptr<Snapshot> snapshot, Opener openLive)
+    : m_openLive(std::move(openLive)),
+      m_snapshot(std::move(snapshot))
+{
+    m_thread = std::thread([this] { connectLoop(); });
+}
+
+WarmStartStorage::~WarmStartStorage() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_liveReady.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+StorageBackend* WarmStartStorage::live() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_live;
+}
+
+void WarmStartStorage::connectLoop() {
+    while (true) {
+        StorageBackend* live = m_openLive();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (live) {
+            m_live = live;
+            // Reads still running keep their reference, the last one unmaps the file
+            m_snapshot.reset();
+            m_liveReady.notify_all();
+            std::cout << "Live storage ready behind the snapshot" << std::endl;
+            return;
+        }
+        if (m_liveReady.wait_for(lock, RETRY_INTERVAL, [this] { return m_stopping; })) {
+            return;
+        }
+    }
+}
+
+StorageBackend* WarmStartStorage::waitLive() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_liveReady.wait_for(lock, WRITE_WAIT_TIMEOUT, [this] { return m_live || m_stopping; });
+    return m_live;
+}
+
+std::shared_ptr<const Snapshot> WarmStartStorage::readSource(StorageBackend*& live) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    live = m_live;
+    return m_snapshot;
+}
+
+bool WarmStartStorage::addCharacter(const CharacterData& character) {
+    StorageBackend* live = waitLive();
+    return live && live->addCharacter(character);
+}
+
+bool WarmStartStorage::addCharacter(const CharacterView& character) {
+    StorageBackend* live = waitLive();
+    return live && live->addCharacter(character);
+}
+
+std::optional<std::vector<int32_t>> WarmStartStorage::addCharacters(const std::vector<CharacterData>& characters) {
+    StorageBackend* live = waitLive();
+    if (!live) {
+        return std::nullopt;
+    }
+    return live->addCharacters(characters);
+}
+
+bool WarmStartStorage::updateCharacter(int id, const CharacterData& character) {
+    StorageBackend* live = waitLive();
+    return live && live->updateCharacter(id, character);
+}
+
+bool WarmStartStorage::updateCharacter(int id, const CharacterView& character) {
+    StorageBackend* live = waitLive();
+    return live && live->updateCharacter(id, character);
+}
+
+bool WarmStartStorage::deleteCharacter(int id) {
+    StorageBackend* live = waitLive();
+    return live && live->deleteCharacter(id);
+}
+
+std::vector<CharacterData> WarmStartStorage::getAllCharacters() {
+    StorageBackend* live = nullptr;
+    if (auto snapshot = readSource(live)) {
+        return snapshot->getAllCharacters();
+    }
+    return live->getAllCharacters();
+}
+
+bool WarmStartStorage::streamAllCharacters(size_t chunkSize, const ChunkSink& sink) {
+    StorageBackend* live = nullptr;
+    if (auto snapshot = readSource(live)) {
+        return snapshot->streamAllCharacters(chunkSize, sink);
+    }
+    return live->streamAllCharacters(chunkSize, sink);
+}
+
+bool WarmStartStorage::readStreamChunk(std::optional<int32_t>& afterId, size_t chunkSize,
+                                       std::vector<uint8_t>& chunk) {
+    StorageBackend* live = nullptr;
+    if (readSource(live)) {
+        // Pages come from the snapshot through getCharacterRange()
+        return StorageBackend::readStreamChunk(afterId, chunkSize, chunk);
+    }
+    // The live backend reads its pages itself and tells an error from the end
+    return live->readStreamChunk(afterId, chunkSize, chunk);
+}
+
+std::vector<CharacterData> WarmStartStorage::getCharacterRange(std::optional<int32_t> afterId,
+                                                              size_t limit, bool descending) {
+    StorageBackend* live = nullptr;
+    if (auto snapshot = readSource(live)) {
+        return snapshot->getCharacterRange(afterId, limit, descending);
+    }
+    return live->getCharacterRange(afterId, limit, descending);
+}
+
+std::optional<CharacterData> WarmStartStorage::getCharacter(int id) {
+    StorageBackend* live = nullptr;
+    if (auto snapshot = readSource(live)) {
+        return snapshot->getCharacter(id);
+    }
+    return live->getCharacter(id);
+}
+
+bool WarmStartStorage::tryGetCharacter(int id, std::optional<CharacterData>& character) {
+    StorageBackend* live = nullptr;
+    if (auto snapshot = readSource(live)) {
+        // The snapshot is mapped, a lookup costs no more than a page fault
+        character = snapshot->getCharacter(id);
+        return true;
+    }
+    return live->tryGetCharacter(id, character);
+}
+
+std::vector<std::optional<CharacterData>> WarmStartStorage::getCharacters(const std::vector<int32_t>& ids) {
+    StorageBackend* live = nullptr;
+    if (auto snapshot = readSource(live)) {
+        std::vector<std::optional<CharacterData>> characters;
+        characters.reserve(ids.size());
+        for (int32_t id : ids) {
+            characters.push_back(snapshot->getCharacter(id));
+        }
+        return characters;
+    }
+    return live->getCharacters(ids);
+}
@@ -0,0 +1,193 @@
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+
+namespace {
+
+// Pool and queue index of the calling worker thread
+thread_local const WorkStealingPool* t_pool = nullptr;
+thread_local size_t t_index = 0;
+
+}
+
+WorkStealingPool::WorkStealingPool(size_t threads) {
+    if (threads == 0) {
+        threads = defaultSize();
+    }
+
+    m_workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    // Every queue exists before the first worker may steal from it
+    m_threads.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        m_threads.emplace_back([this, i]() { run(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    join();
+    shutdown();
+    destroy();
+}
+
+size_t WorkStealingPool::defaultSize() {
+    return std::max<size_t>(1, 2 * std::thread::hardware_concurrency());
+}
+
+void WorkStealingPool::join() {
+    std::lock_guard<std::mutex> joinLock(m_joinMutex);
+    m_joining = true;
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeup.notify_all();
+
+    for (auto& thread : m_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+WorkStealingPool::Stats WorkStealingPool::stats() const {
+    Stats stats;
+    stats.threads = m_workers.size();
+    stats.executed = m_executed;
+    stats.stolen = m_stolen;
+    stats.lifoHits = m_lifoHits;
+    stats.queued = m_queued;
+    stats.maxQueued = m_maxQueued;
+    stats.queueDepths.reserve(m_workers.size());
+    for (const auto& worker : m_workers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        stats.queueDepths.push_back(worker->queue.size() + (worker->lifo ? 1 : 0));
+    }
+    return stats;
+}
+
+void WorkStealingPool::submit(Task task, bool lifo) {
+    bool local = t_pool == this;
+    Worker& worker = local ? *m_workers[t_index]
+                           : *m_workers[m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+
+        // Counted before the task is visible, so the worker taking it never
+        // decrements first
+        size_t queued = ++m_queued;
+        size_t maxQueued = m_maxQueued.load(std::memory_order_relaxed);
+        while (queued > maxQueued && !m_maxQueued.compare_exchange_weak(maxQueued, queued)) {
+        }
+
+        if (local && lifo) {
+            if (worker.lifo) {
+                worker.queue.push_back(std::move(worker.lifo));
+            }
+            worker.lifo = std::move(task);
+        } else {
+            worker.queue.push_back(std::move(task));
+        }
+    }
+
+    // A worker going to sleep counts itself before it checks m_queued, so
+    // either it sees this handler or it is seen here and woken
+    if (m_sleeping > 0) {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+        }
+        m_wakeup.notify_one();
+    }
+}
+
+bool WorkStealingPool::runningInThisThread() const {
+    return t_pool == this;
+}
+
+void WorkStealingPool::run(size_t index) {
+    t_pool = this;
+    t_index = index;
+
+    for (;;) {
+        Task task = take(index);
+        if (task) {
+            --m_queued;
+            task();
+            ++m_executed;
+            continue;
+        }
+
+        if (m_joining) {
+            // Counted handlers not found yet are still being queued
+            if (m_queued == 0) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        ++m_sleeping;
+        m_wakeup.wait(lock, [this]() { return m_queued > 0 || m_joining; });
+        --m_sleeping;
+    }
+
+    t_pool = nullptr;
+}
+
+WorkStealingPool::Task WorkStealingPool::take(size_t index) {
+    Worker& worker = *m_workers[index];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.lifo) {
+            ++m_lifoHits;
+            return std::move(worker.lifo);
+        }
+        if (!worker.queue.empty()) {
+            Task task = std::move(worker.queue.front());
+            worker.queue.pop_front();
+            return task;
+        }
+    }
+    return steal(index);
+}
+
+WorkStealingPool::Task WorkStealingPool::steal(size_t index) {
+    size_t count = m_workers.size();
+    for (size_t offset = 1; offset < count; ++offset) {
+        Worker& victim = *m_workers[(index + offset) % count];
+        Task task;
+        std::vector<Task> taken;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.queue.empty()) {
+                // Half of the queue, oldest first, so one steal balances a burst
+                size_t half = (victim.queue.size() + 1) / 2;
+                task = std::move(victim.queue.front());
+                victim.queue.pop_front();
+                taken.reserve(half - 1);
+                for (size_t i = 1; i < half; ++i) {
+                    taken.push_back(std::move(victim.queue.front()));
+                    victim.queue.pop_front();
+                }
+            } else if (victim.lifo) {
+                // The owner is busy with something else, its next handler would wait
+                task = std::move(victim.lifo);
+            } else {
+                continue;
+            }
+        }
+
+        m_stolen += 1 + taken.size();
+        if (!taken.empty()) {
+            Worker& worker = *m_workers[index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            for (auto& stolen : taken) {
+                worker.queue.push_back(std::move(stolen));
+            }
+        }
+        return task;
+    }
+    return Task();
+}